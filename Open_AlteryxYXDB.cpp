@@ -9,10 +9,28 @@
 
 #ifdef __GNUG__
 #include "unistd.h" // for close
+#include <sys/mman.h> // for mmap
 #else
 #include "io.h"
 #endif
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <exception>
+
+// io_uring is used directly through its syscalls, so all it needs are the kernel headers
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define YXDB_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
 
 #define _LARGEFILE_SOURCE
 #define _LARGEFILE64_SOURCE
@@ -20,27 +38,67 @@
 
 namespace Alteryx  { namespace OpenYXDB
 {
+#ifdef __GNUG__
+	// new files get the usual permissions, less whatever the umask takes away
+	static const int NewFileMode = 0666;
+#endif
 
 	File_Large::File_Large()
 		: m_iFileDescriptor(-1)
+		, m_pDirectBuffer(NULL)
+		, m_nDirectBufferUsed(0)
+		, m_nDirectBufferPos(0)
+		, m_bDirectIOFlag(false)
+		, m_bPreallocated(false)
 	{
 	}
 
 	File_Large::~File_Large()
 	{
-		Close();
+		try
+		{
+			Close();
+		}
+		catch (...)
+		{
+		}
 	}
 
 	void File_Large::Close()
 	{
 		if(m_iFileDescriptor!=-1)
 		{
+			WString strError;
+			if (m_pDirectBuffer)
+			{
+				try
+				{
+					EndDirectIO();
+				}
+				catch (Error e)
+				{
+					strError = e.GetErrorDescription();
+				}
+			}
+#ifdef __linux__
+			// give back the preallocated space past the end of what was written
+			if (m_bPreallocated && strError.empty())
+			{
+				struct stat fileStat;
+				if (fstat(m_iFileDescriptor, &fileStat)!=0 || ftruncate(m_iFileDescriptor, fileStat.st_size)!=0)
+					strError = L"Error in Close: Unable to release the preallocated space.";
+			}
+#endif
+			m_bPreallocated = false;
 #ifdef __GNUG__
 			close(m_iFileDescriptor);
 #else
 			_close(m_iFileDescriptor);
 #endif
 			m_iFileDescriptor = -1;
+
+			if (!strError.empty())
+				throw Error(strError);
 		}
 	}
 
@@ -49,9 +107,7 @@ namespace Alteryx  { namespace OpenYXDB
 		m_strFile = strFile;
 
 #ifdef __GNUG__
-		AString astrFile = ConvertToAString(strFile);
-		if(strchr(astrFile.c_str(), '?')!=nullptr)
-			throw Error(L"Error in OpenForRead: Unicode filenames are not supported");
+		AString astrFile = File_Large::GetNarrowFileName(strFile, L"Error in OpenForRead: ");
 
 		m_iFileDescriptor = open(astrFile.c_str(), O_RDONLY | O_BINARY, 0);
 #else
@@ -63,27 +119,205 @@ namespace Alteryx  { namespace OpenYXDB
 		}
 	}
 
-	void File_Large::OpenForWrite(WString strFile)
+	void File_Large::OpenForUpdate(WString strFile)
 	{
 		m_strFile = strFile;
 
 #ifdef __GNUG__
-		AString astrFile = ConvertToAString(strFile);
-		if(strchr(astrFile.c_str(), '?')!=nullptr)
-			throw Error(L"Error in OpenForRead: Unicode filenames are not supported");
+		AString astrFile = File_Large::GetNarrowFileName(strFile, L"Error in OpenForUpdate: ");
+
+		m_iFileDescriptor = open(astrFile.c_str(), O_RDWR | O_BINARY, 0);
+#else
+		m_iFileDescriptor = _wopen(strFile, _O_RDWR | _O_BINARY);
+#endif
+		if(m_iFileDescriptor == -1)
+			File_Large::GetAndThrowError(L"Error in OpenForUpdate: ");
+	}
+
+	void File_Large::OpenForWrite(WString strFile, bool bDirectIO /*= false*/)
+	{
+		m_strFile = strFile;
 
-		m_iFileDescriptor = open(astrFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0);
+#ifdef __GNUG__
+		AString astrFile = File_Large::GetNarrowFileName(strFile, L"Error in OpenForWrite: ");
+
+		int nFlags = O_WRONLY | O_CREAT | O_TRUNC | O_BINARY;
+#ifdef O_DIRECT
+		if (bDirectIO)
+		{
+			m_iFileDescriptor = open(astrFile.c_str(), nFlags | O_DIRECT, NewFileMode);
+			m_bDirectIOFlag = m_iFileDescriptor!=-1;
+		}
+		// not every file system can do O_DIRECT - the writes will still be staged, just through the page cache
+		if (m_iFileDescriptor == -1)
+#endif
+			m_iFileDescriptor = open(astrFile.c_str(), nFlags, NewFileMode);
 #else
+		// _wopen has no way to ask for unbuffered writes, so direct I/O only gets the staging here
 		m_iFileDescriptor = _wopen(strFile, _O_RDWR  | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE );
 #endif
 
 		if(m_iFileDescriptor == -1)
 			File_Large::GetAndThrowError(L"Error in OpenForWrite: ");
+
+		if (bDirectIO)
+		{
+#ifdef __GNUG__
+			void *pBuffer = NULL;
+			if (posix_memalign(&pBuffer, DirectIOAlignment, DirectIOBufferSize)!=0)
+				pBuffer = NULL;
+#else
+			void *pBuffer = _aligned_malloc(DirectIOBufferSize, DirectIOAlignment);
+#endif
+			if (pBuffer==NULL)
+			{
+				Close();
+				throw Error(L"Error in OpenForWrite: Unable to allocate the direct I/O buffer.");
+			}
+			m_pDirectBuffer = static_cast<unsigned char *>(pBuffer);
+			m_nDirectBufferUsed = 0;
+			m_nDirectBufferPos = 0;
+		}
+	}
+
+	void File_Large::Preallocate(__int64 nSize)
+	{
+		if (nSize<=0)
+			return;
+
+		// this is only an optimization, so a file system that can't do it is not an error
+#ifdef __linux__
+		if (fallocate(m_iFileDescriptor, FALLOC_FL_KEEP_SIZE, 0, nSize)==0)
+			m_bPreallocated = true;
+#elif !defined(__GNUG__)
+		// NTFS gives back the unused allocation itself when the file is closed
+		FILE_ALLOCATION_INFO allocationInfo;
+		allocationInfo.AllocationSize.QuadPart = nSize;
+		SetFileInformationByHandle(reinterpret_cast<HANDLE>(_get_osfhandle(m_iFileDescriptor)), FileAllocationInfo, &allocationInfo, sizeof(allocationInfo));
+#endif
+	}
+
+	void File_Large::SetAccessHint(E_AccessHint hint)
+	{
+#ifdef POSIX_FADV_SEQUENTIAL
+		int nAdvice = POSIX_FADV_NORMAL;
+		if (hint==AH_Sequential)
+			nAdvice = POSIX_FADV_SEQUENTIAL;
+		else if (hint==AH_Random)
+			nAdvice = POSIX_FADV_RANDOM;
+		posix_fadvise(m_iFileDescriptor, 0, 0, nAdvice);
+#endif
+	}
+
+	void File_Large::WillNeed(__int64 nPos, __int64 nSize)
+	{
+#ifdef POSIX_FADV_WILLNEED
+		if (nSize>0)
+			posix_fadvise(m_iFileDescriptor, nPos, nSize, POSIX_FADV_WILLNEED);
+#endif
+	}
+
+	void File_Large::SetDirectIOFlag(bool bDirectIO)
+	{
+#if defined(__GNUG__) && defined(O_DIRECT)
+		if (m_bDirectIOFlag)
+		{
+			int nFlags = fcntl(m_iFileDescriptor, F_GETFL);
+			if (nFlags==-1 || fcntl(m_iFileDescriptor, F_SETFL, bDirectIO ? (nFlags | O_DIRECT) : (nFlags & ~O_DIRECT))==-1)
+				File_Large::GetAndThrowError(L"Error in SetDirectIOFlag: ");
+		}
+#endif
 	}
 
+	// O_DIRECT writes need to be aligned in both position and size.  Anything that isn't is either held back
+	// until there is more, or if it has to go now, it goes through the page cache
+	void File_Large::FlushDirectBuffer(bool bAll)
+	{
+		unsigned nAligned = 0;
+		if ((m_nDirectBufferPos % DirectIOAlignment)==0)
+			nAligned = m_nDirectBufferUsed & ~unsigned(DirectIOAlignment-1);
+
+		if (nAligned!=0)
+			WriteAtRaw(m_nDirectBufferPos, m_pDirectBuffer, nAligned, true);
+
+		// if the position was knocked out of alignment (by an LSeek) a full buffer just has to go as it is
+		if (bAll || (nAligned==0 && m_nDirectBufferUsed==DirectIOBufferSize))
+		{
+			if (m_nDirectBufferUsed>nAligned)
+				WriteAtRaw(m_nDirectBufferPos+nAligned, m_pDirectBuffer+nAligned, m_nDirectBufferUsed-nAligned, false);
+			nAligned = m_nDirectBufferUsed;
+		}
+
+		memmove(m_pDirectBuffer, m_pDirectBuffer+nAligned, m_nDirectBufferUsed-nAligned);
+		m_nDirectBufferUsed -= nAligned;
+		m_nDirectBufferPos += nAligned;
+	}
+
+
+	// everything that is staged goes out, and from then on the file is written through the page cache
+	void File_Large::EndDirectIO()
+	{
+		if (m_pDirectBuffer==NULL)
+			return;
+
+		__int64 nEnd = m_nDirectBufferPos + m_nDirectBufferUsed;
+		WString strError;
+		try
+		{
+			// what is aligned still goes direct, and then O_DIRECT is turned off once for the unaligned tail
+			FlushDirectBuffer(false);
+			SetDirectIOFlag(false);
+			m_bDirectIOFlag = false;
+			FlushDirectBuffer(true);
+		}
+		catch (Error e)
+		{
+			strError = e.GetErrorDescription();
+		}
+#ifdef __GNUG__
+		free(m_pDirectBuffer);
+#else
+		_aligned_free(m_pDirectBuffer);
+#endif
+		m_pDirectBuffer = NULL;
+		m_nDirectBufferUsed = 0;
+		m_nDirectBufferPos = 0;
+		m_bDirectIOFlag = false;
+		if (!strError.empty())
+			throw Error(strError);
+
+		// the direct writes were all positional, so the file position was never moved
+		LSeek(nEnd);
+	}
+
+	__int64 File_Large::GetSize() const
+	{
+		__int64 nSize = 0;
+
+#ifdef __GNUG__
+		struct stat fileStat;
+		if (fstat(m_iFileDescriptor, &fileStat)==0)
+			nSize = fileStat.st_size;
+		else
+			nSize = -1;
+#else
+		struct _stati64 fileStat;
+		if (_fstati64(m_iFileDescriptor, &fileStat)==0)
+			nSize = fileStat.st_size;
+		else
+			nSize = -1;
+#endif
+		if(nSize == -1)
+			File_Large::GetAndThrowError(L"Error in GetSize: ");
+
+		return nSize;
+	}
 
 	__int64 File_Large::Tell() const
 	{
+		if (m_pDirectBuffer)
+			return m_nDirectBufferPos + m_nDirectBufferUsed;
+
 		__int64 seekPos = 0;
 
 #ifdef __GNUG__
@@ -99,6 +333,17 @@ namespace Alteryx  { namespace OpenYXDB
 
 	void File_Large::LSeek(__int64 nPos)
 	{
+		// in direct I/O mode all the writes are positional
+		if (m_pDirectBuffer)
+		{
+			if (nPos!=Tell())
+			{
+				FlushDirectBuffer(true);
+				m_nDirectBufferPos = nPos;
+			}
+			return;
+		}
+
 		__int64 seekPos = 0;
 
 #ifdef __GNUG__
@@ -129,6 +374,23 @@ namespace Alteryx  { namespace OpenYXDB
 
 	unsigned File_Large::Write(const void * _pBuffer, unsigned nNumBytesToWrite)
 	{
+		if (m_pDirectBuffer)
+		{
+			unsigned nRet = nNumBytesToWrite;
+			while (nNumBytesToWrite>0)
+			{
+				unsigned nCopySize = std::min(unsigned(DirectIOBufferSize)-m_nDirectBufferUsed, nNumBytesToWrite);
+				memcpy(m_pDirectBuffer+m_nDirectBufferUsed, _pBuffer, nCopySize);
+				m_nDirectBufferUsed += nCopySize;
+				nNumBytesToWrite -= nCopySize;
+				_pBuffer = static_cast<const char *>(_pBuffer) + nCopySize;
+
+				if (m_nDirectBufferUsed==DirectIOBufferSize)
+					FlushDirectBuffer(false);
+			}
+			return nRet;
+		}
+
 		unsigned ret = 0;
 #ifdef __GNUG__
 		ret = write(m_iFileDescriptor, _pBuffer, nNumBytesToWrite);
@@ -141,6 +403,83 @@ namespace Alteryx  { namespace OpenYXDB
 		return ret;
 	}
 
+	unsigned File_Large::ReadAt(__int64 nPos, void * _pBuffer, unsigned nNumBytesToRead)
+	{
+		unsigned ret = 0;
+
+#ifdef __GNUG__
+		ret = pread(m_iFileDescriptor, _pBuffer, nNumBytesToRead, nPos);
+#else
+		// with an OVERLAPPED the read happens at the given offset, but on the CRT's synchronous handle it still
+		// leaves the file position after what was read.  Putting it back (as WriteAtRaw does) would race with the
+		// other threads reading the same file, and nothing needs it: a file that is read with ReadAt is only ever
+		// read through File_Cursor or File_ReadAhead, which keep their own positions
+		OVERLAPPED overlapped;
+		memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = DWORD(nPos);
+		overlapped.OffsetHigh = DWORD(nPos>>32);
+		DWORD nBytesRead = 0;
+		if (ReadFile(reinterpret_cast<HANDLE>(_get_osfhandle(m_iFileDescriptor)), _pBuffer, nNumBytesToRead, &nBytesRead, &overlapped))
+			ret = nBytesRead;
+#endif
+
+		if(ret != nNumBytesToRead)
+			File_Large::GetAndThrowError(L"Error in ReadAt: Unexpected number of bytes to read");
+
+		return ret;	
+	}
+
+	unsigned File_Large::WriteAt(__int64 nPos, const void * _pBuffer, unsigned nNumBytesToWrite)
+	{
+		if (m_pDirectBuffer)
+		{
+			// if it is still staged, it can just be changed there (the header rewrite on a small file)
+			if (nPos>=m_nDirectBufferPos && nPos+nNumBytesToWrite<=m_nDirectBufferPos+m_nDirectBufferUsed)
+			{
+				memcpy(m_pDirectBuffer+(nPos-m_nDirectBufferPos), _pBuffer, nNumBytesToWrite);
+				return nNumBytesToWrite;
+			}
+
+			// otherwise it is the header rewrite at the very end.  Flushing the unaligned tail now would leave every
+			// write after it unaligned, so the direct writes end here instead of going on without O_DIRECT
+			EndDirectIO();
+		}
+
+		return WriteAtRaw(nPos, _pBuffer, nNumBytesToWrite, false);
+	}
+
+	unsigned File_Large::WriteAtRaw(__int64 nPos, const void * _pBuffer, unsigned nNumBytesToWrite, bool bDirectIO)
+	{
+		unsigned ret = 0;
+
+		if (!bDirectIO)
+			SetDirectIOFlag(false);
+
+#ifdef __GNUG__
+		ret = pwrite(m_iFileDescriptor, _pBuffer, nNumBytesToWrite, nPos);
+#else
+		OVERLAPPED overlapped;
+		memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = DWORD(nPos);
+		overlapped.OffsetHigh = DWORD(nPos>>32);
+		DWORD nBytesWritten = 0;
+		// a synchronous handle still moves its file position with an OVERLAPPED, so put it back
+		__int64 nOldPos = m_pDirectBuffer ? 0 : Tell();
+		if (WriteFile(reinterpret_cast<HANDLE>(_get_osfhandle(m_iFileDescriptor)), _pBuffer, nNumBytesToWrite, &nBytesWritten, &overlapped))
+			ret = nBytesWritten;
+		if (!m_pDirectBuffer)
+			LSeek(nOldPos);
+#endif
+
+		if (!bDirectIO)
+			SetDirectIOFlag(true);
+
+		if(ret != nNumBytesToWrite)
+			File_Large::GetAndThrowError(L"Error in WriteAt: ");
+
+		return ret;
+	}
+
 	/*static*/ void File_Large::GetAndThrowError(WString strErrorIntro)
 	{
 		int nError = errno;
@@ -151,168 +490,1955 @@ namespace Alteryx  { namespace OpenYXDB
 		throw Error(strErrorIntro + errorMsg);
 	}
 
-	Open_AlteryxYXDB::~Open_AlteryxYXDB()
+#ifdef __GNUG__
+	/*static*/ AString File_Large::GetNarrowFileName(WString strFile, WString strErrorIntro)
 	{
-		try
-		{
-			Close();
-		}
-		catch (...)
-		{
-		}
+		AString astrFile = ConvertToAString(strFile);
+		if(strchr(astrFile.c_str(), '?')!=nullptr)
+			throw Error(strErrorIntro + L"Unicode filenames are not supported");
+		return astrFile;
 	}
-	
-	/*virtual*/ void Open_AlteryxYXDB::Close()
-	{
-		if (m_pFile && m_pFile->IsOpen())
-		{
-			if (m_bCreateMode)
-			{
-				m_pCompressOutput->FlushBuffer();
-				m_header.userHdr.nNumRecords = m_nCurrentRecord;
+#endif
 
-				// even if there is only 1 record this should be created
-				//assert(m_vRecordBlockIndexPos.size()>0);
-				m_header.userHdr.nRecordBlockIndexPos = m_pFile->Tell();
-				m_header.userHdr.nCompressionVersion = 1;
+	///////////////////////////////////////////////////////////////////////////////
+	// class File_Memory
 
-				m_pFile->LSeek(0);
-				m_pFile->Write(&m_header, sizeof(m_header));
-				m_pFile->Close();
-			}
-			else
-				m_pFile->Close();
-			
-			m_pFile.reset();
-		}
+	File_Memory::File_Memory()
+		: m_pData(NULL)
+		, m_nSize(0)
+		, m_nPos(0)
+		, m_bIsOpen(false)
+		, m_pvWriteData(NULL)
+	{
 	}
 
-	/*virtual*/ void Open_AlteryxYXDB::Create(WString strFile, const wchar_t *pRecordInfoXml)
+	File_Memory::~File_Memory()
 	{
-		m_pFile.reset(new File_Large()); 
-		m_pFile->OpenForWrite(strFile);
-
-		m_bCreateMode = true;
+		Close();
+	}
 
-		m_header.userHdr.nMetaInfoLen = wcslen(pRecordInfoXml)+1; // +1 to write the NULL terminator for convenience
-		m_header.Write(*m_pFile);
-		m_pFile->Write(pRecordInfoXml, (m_header.userHdr.nMetaInfoLen)*sizeof(wchar_t));
+	void File_Memory::Close()
+	{
+		if (m_pvWriteData)
+			m_pvWriteData->resize(size_t(m_nSize));
+		m_pvWriteData = NULL;
+		m_pData = NULL;
+		m_nSize = 0;
+		m_nPos = 0;
+		m_bIsOpen = false;
+	}
 
-		m_pCompressOutput = new LZFBufferedOutput<File_Large *, GenericEngineBase >(this->m_recordInfo.GetGenericEngine(), m_pFile.get());
+	void File_Memory::OpenForRead(const void *pData, size_t nSize, WString strName /*= L"Memory"*/)
+	{
+		Close();
+		m_strFile = strName;
+		m_pData = static_cast<const unsigned char *>(pData);
+		m_nSize = nSize;
+		m_bIsOpen = true;
+	}
 
-		m_recordInfo.InitFromXml(pRecordInfoXml);
-		m_pRecord = m_recordInfo.CreateRecord();
+	void File_Memory::OpenForWrite(std::vector<unsigned char> &r_vData, WString strName /*= L"Memory"*/)
+	{
+		Close();
+		m_strFile = strName;
+		r_vData.clear();
+		m_pvWriteData = &r_vData;
+		m_bIsOpen = true;
 	}
 
-	/*virtual*/ void Open_AlteryxYXDB::AppendRecord(const RecordData *pRec)
+	void File_Memory::LSeek(__int64 nPos)
 	{
-		if ((m_nCurrentRecord % RecordsPerBlock)==0)
-		{
-			m_pCompressOutput->FlushBuffer();
-			m_vRecordBlockIndexPos.push_back(m_pFile->Tell());
-		}
+		if (nPos<0 || nPos>m_nSize)
+			throw Error(L"Error in LSeek: Attempt to seek past the end of the file");
 
-		m_recordInfo.Write(*m_pCompressOutput, pRec);
-		m_nCurrentRecord++;
+		m_nPos = nPos;
 	}
 
-	/*virtual*/ void Open_AlteryxYXDB::Open(WString strFile)
+	unsigned File_Memory::Read(void * _pBuffer, unsigned nNumBytesToRead)
 	{
-		m_pFile.reset(new File_Large());
-		m_pFile->OpenForRead(strFile);
+		memcpy(_pBuffer, Get(nNumBytesToRead), nNumBytesToRead);
+		return nNumBytesToRead;
+	}
 
-		m_header.Read(*m_pFile);
+	unsigned File_Memory::Write(const void * _pBuffer, unsigned nNumBytesToWrite)
+	{
+		WriteAt(m_nPos, _pBuffer, nNumBytesToWrite);
+		m_nPos += nNumBytesToWrite;
+		return nNumBytesToWrite;
+	}
 
-		m_bIndexStartsBlock = (m_header.fileID & 0xff) == 3;
-		if (m_header.userHdr.nCompressionVersion==1)
-			m_pCompressInput = new LZFBufferedInput<File_Large * >(m_pFile.get());
+	unsigned File_Memory::WriteAt(__int64 nPos, const void * _pBuffer, unsigned nNumBytesToWrite)
+	{
+		if (!m_pvWriteData)
+			throw Error(L"Error in Write: The file is read only");
+		if (nPos<0 || nPos>m_nSize)
+			throw Error(L"Error in WriteAt: Attempt to write past the end of the file");
 
-		String strRecordInfoXml;
-		wchar_t * pRecordInfoXml = strRecordInfoXml.Lock(m_header.userHdr.nMetaInfoLen);
-		m_pFile->Read(pRecordInfoXml, m_header.userHdr.nMetaInfoLen*sizeof(wchar_t));
-		strRecordInfoXml.Unlock();
+		// the vector is kept at least as big as the file, growing it geometrically so appending stays cheap
+		__int64 nEnd = nPos + nNumBytesToWrite;
+		if (nEnd>__int64(m_pvWriteData->size()))
+			m_pvWriteData->resize(size_t(std::max(nEnd, __int64(m_pvWriteData->size())*2)));
+		m_nSize = std::max(m_nSize, nEnd);
+		m_pData = m_pvWriteData->empty() ? NULL : &m_pvWriteData->front();
 
-		m_recordInfo.InitFromXml(strRecordInfoXml);
-		m_pRecord = m_recordInfo.CreateRecord();
+		if (nNumBytesToWrite!=0)
+			memcpy(&m_pvWriteData->front()+nPos, _pBuffer, nNumBytesToWrite);
+		return nNumBytesToWrite;
+	}
 
-		// make sure we are at the first record in the file
-		assert(	m_pFile->Tell() == int(sizeof(m_header) + m_header.userHdr.nMetaInfoLen*sizeof(wchar_t)));
+	const void * File_Memory::Get(unsigned nNumBytes)
+	{
+		const void * pRet = GetAt(m_nPos, nNumBytes);
+		m_nPos += nNumBytes;
+		return pRet;
 	}
-	
-	/*virtual*/ WString Open_AlteryxYXDB::GetRecordXmlMetaData()
+
+	unsigned File_Memory::ReadAt(__int64 nPos, void * _pBuffer, unsigned nNumBytesToRead)
 	{
-		return m_recordInfo.GetRecordXmlMetaData();
+		memcpy(_pBuffer, GetAt(nPos, nNumBytesToRead), nNumBytesToRead);
+		return nNumBytesToRead;
 	}
 
-	/*virtual*/ const RecordData * Open_AlteryxYXDB::ReadRecord()
+	const void * File_Memory::GetAt(__int64 nPos, unsigned nNumBytes)
 	{
-		if (m_nCurrentRecord==m_header.userHdr.nNumRecords)
-			return NULL;
+		if (nPos<0 || nPos>m_nSize || nNumBytes>(m_nSize-nPos))
+			throw Error(L"Error in Read: Unexpected number of bytes to read");
 
-		if ((m_nCurrentRecord % RecordsPerBlock)==0)
-			GoBlockRecord(m_nCurrentRecord);
+		return m_pData + nPos;
+	}
 
-		m_nCurrentRecord++;
-		Record * pRec = m_pRecord.Get();
-		pRec->Reset();
-			
-		if (m_header.userHdr.nCompressionVersion==1)
-			m_recordInfo.Read(*m_pCompressInput, pRec);
-		else
-			m_recordInfo.Read(*m_pFile, pRec);
+	///////////////////////////////////////////////////////////////////////////////
+	// class File_MemoryMapped
 
-		return pRec->GetRecord();
+	File_MemoryMapped::File_MemoryMapped()
+	{
 	}
 
-	/*virtual*/ __int64 Open_AlteryxYXDB::GetNumRecords()
+	File_MemoryMapped::~File_MemoryMapped()
 	{
-		return m_header.userHdr.nNumRecords;
+		Close();
 	}
 
-
-	void Open_AlteryxYXDB::GoBlockRecord(__int64 nRecord)
+	void File_MemoryMapped::Close()
 	{
-		if (nRecord==0)
-		{
-			m_pFile->LSeek(sizeof(m_header) + m_header.userHdr.nMetaInfoLen*sizeof(wchar_t));
-			if (m_pCompressInput.Get())
-				m_pCompressInput->Reset();
-			m_nCurrentRecord = 0;
-		}
-		else
+		if (m_pData)
 		{
-			if (m_vRecordBlockIndexPos.size()==0)
-			{
-				m_pFile->LSeek(m_header.userHdr.nRecordBlockIndexPos);
-				unsigned nNewArraySize=0;
-				m_pFile->Read(&nNewArraySize, sizeof(nNewArraySize));
-				m_vRecordBlockIndexPos.resize(nNewArraySize);
-				
-				m_pFile->Read(&*m_vRecordBlockIndexPos.begin(), nNewArraySize*sizeof(__int64));
-			}
-			__int64 nNewPos = m_vRecordBlockIndexPos[unsigned(nRecord/RecordsPerBlock)];
-			m_pFile->LSeek(nNewPos);
-			if (m_pCompressInput.Get())
-				m_pCompressInput->Reset();
+#ifdef __GNUG__
+			munmap(const_cast<unsigned char *>(m_pData), size_t(m_nSize));
+#else
+			UnmapViewOfFile(m_pData);
+#endif
+			m_pData = NULL;
 		}
+		File_Memory::Close();
 	}
 
-	/*virtual*/ void Open_AlteryxYXDB::GoRecord(__int64 nRecord /*= 0*/)
+	void File_MemoryMapped::OpenForRead(WString strFile)
 	{
-		if (nRecord>=m_header.userHdr.nNumRecords || nRecord<0)
-			throw Error(L"Open_AlteryxYXDB::GoRecord: Attempt to seek past the end of the file");
-		else if (nRecord==m_nCurrentRecord)
-			; // do nothing
-		else
-		{
+		Close();
+		m_strFile = strFile;
+
+#ifdef __GNUG__
+		AString astrFile = File_Large::GetNarrowFileName(strFile, L"Error in OpenForRead: ");
+
+		int iFileDescriptor = open(astrFile.c_str(), O_RDONLY | O_BINARY, 0);
+		if(iFileDescriptor == -1)
+			File_Large::GetAndThrowError(L"Error in OpenForRead: ");
+
+		struct stat fileStat;
+		if (fstat(iFileDescriptor, &fileStat)!=0)
+		{
+			int nError = errno;
+			close(iFileDescriptor);
+			errno = nError;
+			File_Large::GetAndThrowError(L"Error in OpenForRead: ");
+		}
+		m_nSize = fileStat.st_size;
+		if (__int64(size_t(m_nSize))!=m_nSize)
+		{
+			close(iFileDescriptor);
+			throw Error(L"Error in OpenForRead: The file is too large to be memory mapped.");
+		}
+
+		// mmap fails on an empty file
+		if (m_nSize>0)
+		{
+			void *pData = mmap(NULL, size_t(m_nSize), PROT_READ, MAP_SHARED, iFileDescriptor, 0);
+			if (pData==MAP_FAILED)
+			{
+				int nError = errno;
+				close(iFileDescriptor);
+				errno = nError;
+				m_nSize = 0;
+				File_Large::GetAndThrowError(L"Error in OpenForRead: ");
+			}
+			m_pData = static_cast<const unsigned char *>(pData);
+		}
+
+		// the mapping holds its own reference to the file
+		close(iFileDescriptor);
+#else
+		HANDLE hFile = CreateFileW(strFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (hFile==INVALID_HANDLE_VALUE)
+			throw Error(L"Error in OpenForRead: Unable to open " + strFile);
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(hFile, &fileSize))
+		{
+			CloseHandle(hFile);
+			throw Error(L"Error in OpenForRead: Unable to get the size of " + strFile);
+		}
+		m_nSize = fileSize.QuadPart;
+		if (__int64(size_t(m_nSize))!=m_nSize)
+		{
+			CloseHandle(hFile);
+			throw Error(L"Error in OpenForRead: The file is too large to be memory mapped.");
+		}
+
+		// CreateFileMapping fails on an empty file
+		if (m_nSize>0)
+		{
+			HANDLE hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (hMapping!=NULL)
+			{
+				m_pData = static_cast<const unsigned char *>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+
+				// the view holds its own reference to the mapping and the file
+				CloseHandle(hMapping);
+			}
+			if (m_pData==NULL)
+			{
+				CloseHandle(hFile);
+				m_nSize = 0;
+				throw Error(L"Error in OpenForRead: Unable to memory map " + strFile);
+			}
+		}
+		CloseHandle(hFile);
+#endif
+		m_bIsOpen = true;
+	}
+
+	void File_MemoryMapped::SetAccessHint(E_AccessHint hint)
+	{
+#ifdef __GNUG__
+		if (m_pData!=NULL)
+		{
+			int nAdvice = MADV_NORMAL;
+			if (hint==AH_Sequential)
+				nAdvice = MADV_SEQUENTIAL;
+			else if (hint==AH_Random)
+				nAdvice = MADV_RANDOM;
+			madvise(const_cast<unsigned char *>(m_pData), size_t(m_nSize), nAdvice);
+		}
+#endif
+	}
+
+	void File_MemoryMapped::WillNeed(__int64 nPos, __int64 nSize)
+	{
+#ifdef __GNUG__
+		if (m_pData!=NULL && nPos>=0 && nPos<m_nSize && nSize>0)
+		{
+			// madvise needs a page aligned address
+			__int64 nPageSize = sysconf(_SC_PAGESIZE);
+			__int64 nStart = nPos - nPos%nPageSize;
+			__int64 nEnd = std::min(nPos+nSize, m_nSize);
+			madvise(const_cast<unsigned char *>(m_pData+nStart), size_t(nEnd-nStart), MADV_WILLNEED);
+		}
+#endif
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	// class File_Stream
+
+	File_Stream::File_Stream()
+		: m_iFileDescriptor(-1)
+		, m_nPos(0)
+	{
+	}
+
+	File_Stream::~File_Stream()
+	{
+		Close();
+	}
+
+	void File_Stream::Close()
+	{
+		if(m_iFileDescriptor!=-1)
+		{
+#ifdef __GNUG__
+			close(m_iFileDescriptor);
+#else
+			_close(m_iFileDescriptor);
+#endif
+			m_iFileDescriptor = -1;
+		}
+		m_nPos = 0;
+	}
+
+	void File_Stream::OpenForRead(WString strFile)
+	{
+		Close();
+		m_strFile = strFile;
+
+#ifdef __GNUG__
+		AString astrFile = File_Large::GetNarrowFileName(strFile, L"Error in OpenForRead: ");
+
+		m_iFileDescriptor = open(astrFile.c_str(), O_RDONLY | O_BINARY, 0);
+#else
+		m_iFileDescriptor = _wopen(strFile, _O_RDONLY | _O_BINARY);
+#endif
+
+		if(m_iFileDescriptor == -1)
+			File_Large::GetAndThrowError(L"Error in OpenForRead: ");
+	}
+
+	void File_Stream::OpenForWrite(WString strFile)
+	{
+		Close();
+		m_strFile = strFile;
+
+		// O_TRUNC does nothing to a pipe, but makes a regular file start out empty
+#ifdef __GNUG__
+		AString astrFile = File_Large::GetNarrowFileName(strFile, L"Error in OpenForWrite: ");
+
+		m_iFileDescriptor = open(astrFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, NewFileMode);
+#else
+		m_iFileDescriptor = _wopen(strFile, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#endif
+
+		if(m_iFileDescriptor == -1)
+			File_Large::GetAndThrowError(L"Error in OpenForWrite: ");
+	}
+
+	void File_Stream::LSeek(__int64 nPos)
+	{
+		if (nPos<m_nPos)
+			throw Error(L"Error in LSeek: Attempt to seek backwards in a stream");
+
+		char skipBuffer[0x10000];
+		while (m_nPos<nPos)
+			Read(skipBuffer, unsigned(std::min(__int64(sizeof(skipBuffer)), nPos-m_nPos)));
+	}
+
+	unsigned File_Stream::Read(void * _pBuffer, unsigned nNumBytesToRead)
+	{
+		// a pipe can return less than was asked for without being at the end
+		unsigned nTotal = 0;
+		while (nTotal<nNumBytesToRead)
+		{
+#ifdef __GNUG__
+			int ret = read(m_iFileDescriptor, static_cast<char *>(_pBuffer)+nTotal, nNumBytesToRead-nTotal);
+			if (ret<0 && errno==EINTR)
+				continue;
+#else
+			int ret = _read(m_iFileDescriptor, static_cast<char *>(_pBuffer)+nTotal, nNumBytesToRead-nTotal);
+#endif
+			if (ret<0)
+				File_Large::GetAndThrowError(L"Error in Read: ");
+			if (ret==0)
+				throw Error(L"Error in Read: Unexpected end of the stream");
+			nTotal += ret;
+			m_nPos += ret;
+		}
+		return nTotal;
+	}
+
+	unsigned File_Stream::Write(const void * _pBuffer, unsigned nNumBytesToWrite)
+	{
+		// same as reading - a pipe can take less than it was given
+		unsigned nTotal = 0;
+		while (nTotal<nNumBytesToWrite)
+		{
+#ifdef __GNUG__
+			int ret = write(m_iFileDescriptor, static_cast<const char *>(_pBuffer)+nTotal, nNumBytesToWrite-nTotal);
+			if (ret<0 && errno==EINTR)
+				continue;
+#else
+			int ret = _write(m_iFileDescriptor, static_cast<const char *>(_pBuffer)+nTotal, nNumBytesToWrite-nTotal);
+#endif
+			if (ret<=0)
+				File_Large::GetAndThrowError(L"Error in Write: ");
+			nTotal += ret;
+			m_nPos += ret;
+		}
+		return nTotal;
+	}
+
+	unsigned File_Stream::WriteAt(__int64 /*nPos*/, const void * /*_pBuffer*/, unsigned /*nNumBytesToWrite*/)
+	{
+		throw Error(L"Error in WriteAt: A stream can only be written in order");
+	}
+
+	unsigned File_Stream::ReadAt(__int64 nPos, void * _pBuffer, unsigned nNumBytesToRead)
+	{
+		LSeek(nPos);
+		return Read(_pBuffer, nNumBytesToRead);
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	// class ReadAheadThreadEngine
+	// 
+	// does the reads for File_ReadAhead, 1 at a time and in order, in a background thread
+	class ReadAheadThreadEngine : public File_ReadAhead::Engine
+	{
+		File_Large &m_file;
+
+		std::mutex m_mutex;
+		std::condition_variable m_cvWork;
+		std::condition_variable m_cvDone;
+		std::deque<File_ReadAhead::Chunk *> m_queue;
+		File_ReadAhead::Chunk *m_pReading;
+		bool m_bStop;
+
+		std::thread m_thread;
+
+		void ThreadProc()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			for (;;)
+			{
+				while (m_queue.empty() && !m_bStop)
+					m_cvWork.wait(lock);
+				if (m_bStop)
+					break;
+
+				m_pReading = m_queue.front();
+				m_queue.pop_front();
+
+				lock.unlock();
+				try
+				{
+					m_file.ReadAt(m_pReading->nPos, m_pReading->pBuffer.get(), m_pReading->nSize);
+				}
+				catch (Error e)
+				{
+					m_pReading->strError = e.GetErrorDescription();
+				}
+				lock.lock();
+
+				m_pReading = NULL;
+				m_cvDone.notify_all();
+			}
+		}
+
+		inline bool IsQueued(File_ReadAhead::Chunk *pChunk) const
+		{
+			return m_pReading==pChunk || std::find(m_queue.begin(), m_queue.end(), pChunk)!=m_queue.end();
+		}
+
+	public:
+		ReadAheadThreadEngine(File_Large &file)
+			: m_file(file)
+			, m_pReading(NULL)
+			, m_bStop(false)
+		{
+			m_thread = std::thread(&ReadAheadThreadEngine::ThreadProc, this);
+		}
+
+		~ReadAheadThreadEngine()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_bStop = true;
+			}
+			m_cvWork.notify_one();
+			m_thread.join();
+		}
+
+		void Start(File_ReadAhead::Chunk *pChunk)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_queue.push_back(pChunk);
+			}
+			m_cvWork.notify_one();
+		}
+
+		void Wait(File_ReadAhead::Chunk *pChunk)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (IsQueued(pChunk))
+				m_cvDone.wait(lock);
+		}
+	};
+
+#ifdef YXDB_IO_URING
+	///////////////////////////////////////////////////////////////////////////////
+	// class ReadAheadIoUringEngine
+	// 
+	// does the reads for File_ReadAhead with io_uring, so they are all in flight in the kernel at once
+	// and no thread is needed.  Create throws if the kernel doesn't support it.
+	class ReadAheadIoUringEngine : public File_ReadAhead::Engine
+	{
+		File_Large &m_file;
+		unsigned m_nChunkSize;
+		int m_iRingFileDescriptor;
+		// io_uring_enter failed, so everything after that is read straight away
+		bool m_bFailed;
+
+		void *m_pSqRing;
+		size_t m_nSqRingSize;
+		void *m_pCqRing;
+		size_t m_nCqRingSize;
+		io_uring_sqe *m_pSqes;
+		size_t m_nSqesSize;
+
+		unsigned *m_pSqTail;
+		unsigned *m_pSqMask;
+		unsigned *m_pSqArray;
+		unsigned *m_pCqHead;
+		unsigned *m_pCqTail;
+		unsigned *m_pCqMask;
+		io_uring_cqe *m_pCqes;
+
+		// the readv needs its iovec to stay put until the read is done.
+		// pAbandoned is the buffer of a read that was given up on - see Wait
+		struct Request
+		{
+			File_ReadAhead::Chunk *pChunk;
+			iovec iov;
+			bool bDone;
+			int nResult;
+			std::unique_ptr<unsigned char[]> pAbandoned;
+		};
+		std::vector<Request> m_vRequests;
+
+		// FindRequest(NULL) finds a free one
+		Request * FindRequest(File_ReadAhead::Chunk *pChunk)
+		{
+			for (auto it = m_vRequests.begin(); it!=m_vRequests.end(); ++it)
+			{
+				if (it->pChunk==pChunk && (pChunk!=NULL || it->bDone))
+					return &*it;
+			}
+			return NULL;
+		}
+
+		void ReadNow(File_ReadAhead::Chunk *pChunk)
+		{
+			try
+			{
+				m_file.ReadAt(pChunk->nPos, pChunk->pBuffer.get(), pChunk->nSize);
+			}
+			catch (Error e)
+			{
+				pChunk->strError = e.GetErrorDescription();
+			}
+		}
+
+		void Release()
+		{
+			if (m_pSqes)
+				munmap(m_pSqes, m_nSqesSize);
+			if (m_pCqRing && m_pCqRing!=m_pSqRing)
+				munmap(m_pCqRing, m_nCqRingSize);
+			if (m_pSqRing)
+				munmap(m_pSqRing, m_nSqRingSize);
+			if (m_iRingFileDescriptor!=-1)
+				close(m_iRingFileDescriptor);
+		}
+
+		// moves everything off the completion queue into m_vRequests
+		void ReapCompletions()
+		{
+			unsigned nHead = *m_pCqHead;
+			while (nHead!=__atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE))
+			{
+				const io_uring_cqe &cqe = m_pCqes[nHead & *m_pCqMask];
+				Request *pRequest = &m_vRequests[size_t(cqe.user_data)];
+				pRequest->nResult = cqe.res;
+				pRequest->bDone = true;
+				pRequest->pAbandoned.reset();
+				++nHead;
+			}
+			__atomic_store_n(m_pCqHead, nHead, __ATOMIC_RELEASE);
+		}
+
+		ReadAheadIoUringEngine(const ReadAheadIoUringEngine &);
+		ReadAheadIoUringEngine & operator =(const ReadAheadIoUringEngine &);
+	public:
+		ReadAheadIoUringEngine(File_Large &file, unsigned nNumChunks, unsigned nChunkSize)
+			: m_file(file)
+			, m_nChunkSize(nChunkSize)
+			, m_iRingFileDescriptor(-1)
+			, m_bFailed(false)
+			, m_pSqRing(NULL)
+			, m_nSqRingSize(0)
+			, m_pCqRing(NULL)
+			, m_nCqRingSize(0)
+			, m_pSqes(NULL)
+			, m_nSqesSize(0)
+			, m_vRequests(nNumChunks)
+		{
+			io_uring_params params;
+			memset(&params, 0, sizeof(params));
+			m_iRingFileDescriptor = int(syscall(__NR_io_uring_setup, nNumChunks, &params));
+			if (m_iRingFileDescriptor<0)
+			{
+				m_iRingFileDescriptor = -1;
+				File_Large::GetAndThrowError(L"Error in io_uring_setup: ");
+			}
+
+			m_nSqRingSize = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+			m_nCqRingSize = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+			if (params.features & IORING_FEAT_SINGLE_MMAP)
+				m_nSqRingSize = m_nCqRingSize = std::max(m_nSqRingSize, m_nCqRingSize);
+
+			m_pSqRing = mmap(NULL, m_nSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_iRingFileDescriptor, IORING_OFF_SQ_RING);
+			if (m_pSqRing==MAP_FAILED)
+			{
+				m_pSqRing = NULL;
+				Release();
+				throw Error(L"Error in io_uring_setup: Unable to map the submission queue");
+			}
+			if (params.features & IORING_FEAT_SINGLE_MMAP)
+				m_pCqRing = m_pSqRing;
+			else
+			{
+				m_pCqRing = mmap(NULL, m_nCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_iRingFileDescriptor, IORING_OFF_CQ_RING);
+				if (m_pCqRing==MAP_FAILED)
+				{
+					m_pCqRing = NULL;
+					Release();
+					throw Error(L"Error in io_uring_setup: Unable to map the completion queue");
+				}
+			}
+			m_nSqesSize = params.sq_entries*sizeof(io_uring_sqe);
+			m_pSqes = static_cast<io_uring_sqe *>(mmap(NULL, m_nSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_iRingFileDescriptor, IORING_OFF_SQES));
+			if (m_pSqes==MAP_FAILED)
+			{
+				m_pSqes = NULL;
+				Release();
+				throw Error(L"Error in io_uring_setup: Unable to map the submission queue entries");
+			}
+
+			char *pSq = static_cast<char *>(m_pSqRing);
+			m_pSqTail = reinterpret_cast<unsigned *>(pSq + params.sq_off.tail);
+			m_pSqMask = reinterpret_cast<unsigned *>(pSq + params.sq_off.ring_mask);
+			m_pSqArray = reinterpret_cast<unsigned *>(pSq + params.sq_off.array);
+
+			char *pCq = static_cast<char *>(m_pCqRing);
+			m_pCqHead = reinterpret_cast<unsigned *>(pCq + params.cq_off.head);
+			m_pCqTail = reinterpret_cast<unsigned *>(pCq + params.cq_off.tail);
+			m_pCqMask = reinterpret_cast<unsigned *>(pCq + params.cq_off.ring_mask);
+			m_pCqes = reinterpret_cast<io_uring_cqe *>(pCq + params.cq_off.cqes);
+
+			for (auto it = m_vRequests.begin(); it!=m_vRequests.end(); ++it)
+			{
+				it->pChunk = NULL;
+				it->bDone = true;
+				it->nResult = 0;
+			}
+		}
+
+		~ReadAheadIoUringEngine()
+		{
+			// File_ReadAhead waits for everything before letting go of the engine, but an abandoned read
+			// could still land after the ring is gone.  Its buffer is leaked rather than risk that
+			for (auto it = m_vRequests.begin(); it!=m_vRequests.end(); ++it)
+			{
+				if (!it->bDone)
+					it->pAbandoned.release();
+			}
+			Release();
+		}
+
+		void Start(File_ReadAhead::Chunk *pChunk)
+		{
+			if (m_bFailed)
+			{
+				ReadNow(pChunk);
+				return;
+			}
+
+			// File_ReadAhead never has more reads in flight than chunks, so there is always a free one
+			Request *pRequest = FindRequest(pChunk);
+			if (pRequest==NULL)
+				pRequest = FindRequest(NULL);
+			assert(pRequest && pRequest->bDone);
+
+			pRequest->pChunk = pChunk;
+			pRequest->iov.iov_base = pChunk->pBuffer.get();
+			pRequest->iov.iov_len = pChunk->nSize;
+			pRequest->bDone = false;
+			pRequest->nResult = 0;
+
+			unsigned nTail = *m_pSqTail;
+			unsigned nIndex = nTail & *m_pSqMask;
+			io_uring_sqe &sqe = m_pSqes[nIndex];
+			memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = IORING_OP_READV;
+			sqe.fd = m_file.GetFileDescriptor();
+			sqe.addr = reinterpret_cast<unsigned long long>(&pRequest->iov);
+			sqe.len = 1;
+			sqe.off = pChunk->nPos;
+			sqe.user_data = pRequest - &m_vRequests[0];
+			m_pSqArray[nIndex] = nIndex;
+			__atomic_store_n(m_pSqTail, nTail+1, __ATOMIC_RELEASE);
+
+			int nSubmitted;
+			do
+				nSubmitted = int(syscall(__NR_io_uring_enter, m_iRingFileDescriptor, 1, 0, 0, NULL, 0));
+			while (nSubmitted<0 && errno==EINTR);
+			if (nSubmitted!=1)
+			{
+				// it never made it into the kernel, so just read it now
+				__atomic_store_n(m_pSqTail, nTail, __ATOMIC_RELEASE);
+				pRequest->pChunk = NULL;
+				pRequest->bDone = true;
+				ReadNow(pChunk);
+			}
+		}
+
+		void Wait(File_ReadAhead::Chunk *pChunk)
+		{
+			Request *pRequest = FindRequest(pChunk);
+			if (pRequest==NULL)
+				return;
+
+			ReapCompletions();
+			while (!pRequest->bDone)
+			{
+				int nRet = int(syscall(__NR_io_uring_enter, m_iRingFileDescriptor, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0));
+				if (nRet<0 && errno!=EINTR)
+				{
+					int nError = errno;
+					// the read is still out there and might yet write into the chunk's buffer, so the request
+					// keeps that buffer and the chunk gets a new one.  The ring isn't used again after this
+					pRequest->pAbandoned = std::move(pChunk->pBuffer);
+					pRequest->pChunk = NULL;
+					pChunk->pBuffer.reset(new unsigned char[m_nChunkSize]);
+					pChunk->strError = L"Error in io_uring_enter: " + ConvertToWString(strerror(nError));
+					m_bFailed = true;
+					return;
+				}
+				ReapCompletions();
+			}
+			pRequest->pChunk = NULL;
+
+			if (pRequest->nResult<0)
+				pChunk->strError = L"Error in ReadAt: " + ConvertToWString(strerror(-pRequest->nResult));
+			else if (unsigned(pRequest->nResult)<pChunk->nSize)
+			{
+				// a short read - just get the rest the old fashioned way
+				try
+				{
+					m_file.ReadAt(pChunk->nPos+pRequest->nResult, pChunk->pBuffer.get()+pRequest->nResult, pChunk->nSize-pRequest->nResult);
+				}
+				catch (Error e)
+				{
+					pChunk->strError = e.GetErrorDescription();
+				}
+			}
+		}
+	};
+#endif
+
+	File_ReadAhead::File_ReadAhead(std::shared_ptr<File_Large> pFile, unsigned nNumChunks /*= 4*/, unsigned nChunkSize /*= 0x40000*/, bool bIoUring /*= true*/)
+		: m_pFile(pFile)
+		, m_nFileSize(pFile->GetSize())
+		, m_nPos(0)
+		, m_nChunkSize(nChunkSize)
+		, m_vChunks(std::max(nNumChunks, 2u))
+		, m_nHead(0)
+		, m_nReadAheadEnd(0)
+	{
+		for (auto it = m_vChunks.begin(); it!=m_vChunks.end(); ++it)
+			it->pBuffer.reset(new unsigned char[m_nChunkSize]);
+
+#ifdef YXDB_IO_URING
+		try
+		{
+			if (bIoUring)
+				m_pEngine.reset(new ReadAheadIoUringEngine(*m_pFile, unsigned(m_vChunks.size()), m_nChunkSize));
+		}
+		catch (Error)
+		{
+			// no io_uring in this kernel (or it is turned off)
+		}
+#endif
+		if (!m_pEngine)
+			m_pEngine.reset(new ReadAheadThreadEngine(*m_pFile));
+	}
+
+	File_ReadAhead::~File_ReadAhead()
+	{
+		Close();
+	}
+
+	void File_ReadAhead::WaitForAll()
+	{
+		for (auto it = m_vChunks.begin(); it!=m_vChunks.end(); ++it)
+		{
+			if (it->bPending)
+			{
+				m_pEngine->Wait(&*it);
+				it->bPending = false;
+			}
+		}
+	}
+
+	void File_ReadAhead::Close()
+	{
+		// nothing can go away while the engine might still be reading into it
+		if (m_pEngine)
+		{
+			WaitForAll();
+			m_pEngine.reset();
+		}
+		m_vChunks.clear();
+		m_pFile.reset();
+		m_nPos = 0;
+	}
+
+	void File_ReadAhead::StartChunk(Chunk &chunk, __int64 nPos)
+	{
+		chunk.nPos = nPos;
+		chunk.nSize = unsigned(std::min(__int64(m_nChunkSize), m_nFileSize-nPos));
+		chunk.strError.clear();
+		if (chunk.nSize!=0)
+		{
+			chunk.bPending = true;
+			m_pEngine->Start(&chunk);
+		}
+		m_nReadAheadEnd = nPos + chunk.nSize;
+	}
+
+	void File_ReadAhead::Restart(__int64 nPos)
+	{
+		WaitForAll();
+		m_nHead = 0;
+		for (auto it = m_vChunks.begin(); it!=m_vChunks.end(); ++it)
+			StartChunk(*it, std::min(nPos + __int64(it-m_vChunks.begin())*m_nChunkSize, m_nFileSize));
+	}
+
+	const unsigned char * File_ReadAhead::Fetch(__int64 nPos, unsigned &r_nAvailable)
+	{
+		if (nPos>=m_nFileSize)
+			throw Error(L"Error in Read: Unexpected number of bytes to read");
+
+		if (m_vChunks.empty())
+			throw Error(L"Error in Read: The file is not open");
+
+		if (nPos<m_vChunks[m_nHead].nPos || nPos>=m_nReadAheadEnd)
+			Restart(nPos);
+
+		// everything before nPos is done with, so those chunks can start reading further ahead
+		for (;;)
+		{
+			Chunk &chunk = m_vChunks[m_nHead];
+			if (nPos<chunk.nPos+chunk.nSize)
+				break;
+
+			if (chunk.bPending)
+			{
+				m_pEngine->Wait(&chunk);
+				chunk.bPending = false;
+			}
+			StartChunk(chunk, m_nReadAheadEnd);
+			m_nHead = (m_nHead+1) % m_vChunks.size();
+		}
+
+		Chunk &chunk = m_vChunks[m_nHead];
+		if (chunk.bPending)
+		{
+			m_pEngine->Wait(&chunk);
+			chunk.bPending = false;
+		}
+		if (!chunk.strError.empty())
+		{
+			WString strError = chunk.strError;
+
+			// make sure it gets read again if anyone tries again
+			WaitForAll();
+			m_nReadAheadEnd = m_vChunks[m_nHead].nPos;
+			throw Error(strError);
+		}
+
+		r_nAvailable = unsigned(chunk.nPos + chunk.nSize - nPos);
+		return chunk.pBuffer.get() + (nPos-chunk.nPos);
+	}
+
+	void File_ReadAhead::LSeek(__int64 nPos)
+	{
+		if (nPos<0)
+			throw Error(L"Error in LSeek: Attempt to seek before the start of the file");
+
+		// the read ahead restarts (if it needs to) on the next Read
+		m_nPos = nPos;
+	}
+
+	unsigned File_ReadAhead::Read(void * _pBuffer, unsigned nNumBytesToRead)
+	{
+		unsigned nRet = nNumBytesToRead;
+		while (nNumBytesToRead>0)
+		{
+			unsigned nAvailable = 0;
+			const unsigned char *pData = Fetch(m_nPos, nAvailable);
+			unsigned nCopySize = std::min(nAvailable, nNumBytesToRead);
+			memcpy(_pBuffer, pData, nCopySize);
+			m_nPos += nCopySize;
+			nNumBytesToRead -= nCopySize;
+			_pBuffer = static_cast<char *>(_pBuffer) + nCopySize;
+		}
+		return nRet;
+	}
+
+	unsigned File_ReadAhead::Write(const void * /*_pBuffer*/, unsigned /*nNumBytesToWrite*/)
+	{
+		throw Error(L"Error in Write: A read ahead file is read only");
+	}
+
+	const void * File_ReadAhead::Get(unsigned nNumBytes)
+	{
+		if (nNumBytes==0)
+			return NULL;
+
+		unsigned nAvailable = 0;
+		const unsigned char *pData = Fetch(m_nPos, nAvailable);
+		if (nAvailable<nNumBytes)
+			return NULL;
+
+		m_nPos += nNumBytes;
+		return pData;
+	}
+
+	File_Cursor::File_Cursor(std::shared_ptr<FileBase> pFile, __int64 nPos /*= 0*/)
+		: m_pFile(pFile)
+		, m_nPos(nPos)
+	{
+	}
+
+	void File_Cursor::Close()
+	{
+		// the shared file gets closed when the last cursor lets go of it
+		m_pFile.reset();
+		m_nPos = 0;
+	}
+
+	void File_Cursor::LSeek(__int64 nPos)
+	{
+		if (nPos<0)
+			throw Error(L"Error in LSeek: Attempt to seek before the start of the file");
+
+		m_nPos = nPos;
+	}
+
+	unsigned File_Cursor::Read(void * _pBuffer, unsigned nNumBytesToRead)
+	{
+		unsigned ret = m_pFile->ReadAt(m_nPos, _pBuffer, nNumBytesToRead);
+		m_nPos += ret;
+		return ret;
+	}
+
+	unsigned File_Cursor::Write(const void * /*_pBuffer*/, unsigned /*nNumBytesToWrite*/)
+	{
+		throw Error(L"Error in Write: A file cursor is read only");
+	}
+
+	const void * File_Cursor::Get(unsigned nNumBytes)
+	{
+		const void * pRet = m_pFile->GetAt(m_nPos, nNumBytes);
+		if (pRet)
+			m_nPos += nNumBytes;
+		return pRet;
+	}
+
+	Open_AlteryxYXDB::~Open_AlteryxYXDB()
+	{
+		try
+		{
+			Close();
+		}
+		catch (...)
+		{
+		}
+	}
+	
+	/*virtual*/ void Open_AlteryxYXDB::Close()
+	{
+		// the read ahead threads are joined before the file they read from goes away
+		m_pCompressInput.reset();
+		m_pBufferedInput.reset();
+
+		if (m_pFile && m_pFile->IsOpen())
+		{
+			if (m_bCreateMode)
+			{
+				if (m_header.userHdr.nFormatFlags & FF_StreamTrailer)
+					m_pCompressOutput->WriteEndMarker();
+				else
+					m_pCompressOutput->FlushBuffer();
+				// everything is written, so this just joins the compression threads
+				m_pCompressOutput.reset();
+				m_header.userHdr.nNumRecords = m_nCurrentRecord;
+
+				// even if there is only 1 record this should be created
+				//assert(m_vRecordBlockIndexPos.size()>0);
+				m_header.userHdr.nRecordBlockIndexPos = m_pFile->Tell();
+
+				// the record block index is what lets a reader jump to (and start decompressing at) any 64K block
+				// the count and the positions go out in 1 write
+				unsigned nBlockIndexSize = unsigned(m_vRecordBlockIndexPos.size());
+				std::vector<char> vBlockIndex(sizeof(nBlockIndexSize) + nBlockIndexSize*sizeof(__int64));
+				memcpy(&vBlockIndex[0], &nBlockIndexSize, sizeof(nBlockIndexSize));
+				if (nBlockIndexSize!=0)
+					memcpy(&vBlockIndex[sizeof(nBlockIndexSize)], &*m_vRecordBlockIndexPos.begin(), nBlockIndexSize*sizeof(__int64));
+				m_pFile->Write(&vBlockIndex[0], unsigned(vBlockIndex.size()));
+
+				if (m_header.userHdr.nFormatFlags & FF_BlockDirectory)
+				{
+					m_header.userHdr.nBlockDirectoryPos = m_pFile->Tell();
+					unsigned nNumBlocks = unsigned(m_vBlockDirectory.size());
+					m_pFile->Write(&nNumBlocks, sizeof(nNumBlocks));
+					if (nNumBlocks!=0)
+						m_pFile->Write(&m_vBlockDirectory[0], unsigned(nNumBlocks*sizeof(LZFBlockEntry)));
+				}
+
+				// no need to seek back just to rewrite the header.  A stream can't at all, so it gets the trailer instead
+				if (m_header.userHdr.nFormatFlags & FF_StreamTrailer)
+					m_pFile->Write(&m_header, sizeof(m_header));
+				else
+					m_pFile->WriteAt(0, &m_header, sizeof(m_header));
+				m_pFile->Close();
+			}
+			else
+				m_pFile->Close();
+			
+			m_pFile.reset();
+		}
+		m_pSharedFile.reset();
+	}
+
+	/*virtual*/ void Open_AlteryxYXDB::Create(WString strFile, const wchar_t *pRecordInfoXml)
+	{
+		if (m_bStreamOutput)
+		{
+			File_Stream *pFile = new File_Stream();
+			m_pFile.reset(pFile); 
+			pFile->OpenForWrite(strFile);
+
+			// the header is final as soon as it is written
+			m_header.userHdr.nFormatFlags |= FF_StreamTrailer;
+			m_header.userHdr.nNumRecords = -1;
+		}
+		else
+		{
+			File_Large *pFile = new File_Large();
+			m_pFile.reset(pFile); 
+			pFile->OpenForWrite(strFile, m_bDirectIO);
+			pFile->Preallocate(m_nExpectedSize);
+		}
+
+		InitCreate(pRecordInfoXml);
+	}
+
+	/*virtual*/ void Open_AlteryxYXDB::CreateInMemory(std::vector<unsigned char> &r_vData, const wchar_t *pRecordInfoXml)
+	{
+		File_Memory *pFile = new File_Memory();
+		m_pFile.reset(pFile); 
+		pFile->OpenForWrite(r_vData);
+
+		InitCreate(pRecordInfoXml);
+	}
+
+	void Open_AlteryxYXDB::InitCreate(const wchar_t *pRecordInfoXml)
+	{
+		m_bCreateMode = true;
+
+		m_header.userHdr.nCompressionVersion = m_codec.m_codec;
+		if (m_codec.m_codec!=BC_LZF)
+			m_header.userHdr.nFormatFlags |= FF_BlockCodec;
+		if (m_nBlockSize!=LZFDefaultBlockSize)
+		{
+			m_header.userHdr.nFormatFlags |= FF_BlockSize;
+			m_header.userHdr.nBlockSize = m_nBlockSize;
+		}
+		if (m_bChecksums)
+			m_header.userHdr.nFormatFlags |= FF_BlockChecksum;
+		if (m_bBlockDirectory)
+			m_header.userHdr.nFormatFlags |= FF_BlockDirectory;
+
+		m_header.userHdr.nMetaInfoLen = wcslen(pRecordInfoXml)+1; // +1 to write the NULL terminator for convenience
+		m_header.Write(*m_pFile);
+		m_pFile->Write(pRecordInfoXml, (m_header.userHdr.nMetaInfoLen)*sizeof(wchar_t));
+
+		m_pCompressOutput.reset(new LZFBufferedOutput<FileBase *, GenericEngineBase >(this->m_recordInfo.GetGenericEngine(), m_pFile.get(), m_nCompressionThreads, m_codec, m_nBlockSize, m_pBufferPool));
+		m_pCompressOutput->SetSkipIncompressible(m_bSkipIncompressible);
+		m_pCompressOutput->SetChecksums(m_bChecksums);
+		if (m_bBlockDirectory)
+			m_pCompressOutput->SetBlockDirectory(&m_vBlockDirectory);
+
+		m_recordInfo.InitFromXml(pRecordInfoXml);
+		m_pRecord = m_recordInfo.CreateRecord();
+	}
+
+	/*virtual*/ void Open_AlteryxYXDB::AppendRecord(const RecordData *pRec)
+	{
+		if ((m_nCurrentRecord % RecordsPerBlock)==0)
+		{
+			m_pCompressOutput->FlushBuffer();
+			m_vRecordBlockIndexPos.push_back(m_pFile->Tell());
+		}
+
+		if (m_bBlockDirectory)
+			m_pCompressOutput->StartRecord(m_nCurrentRecord);
+		m_recordInfo.Write(*m_pCompressOutput, pRec);
+		m_nCurrentRecord++;
+	}
+
+	/*virtual*/ void Open_AlteryxYXDB::Open(WString strFile, E_FileAccess fileAccess /*= FA_Default*/)
+	{
+		m_fileAccess = fileAccess;
+		switch (fileAccess)
+		{
+		case FA_MemoryMapped:
+			{
+				std::shared_ptr<File_MemoryMapped> pFile(new File_MemoryMapped());
+				pFile->OpenForRead(strFile);
+				m_pSharedFile = pFile;
+			}
+			break;
+		case FA_Stream:
+			{
+				std::shared_ptr<File_Stream> pFile(new File_Stream());
+				pFile->OpenForRead(strFile);
+				m_pSharedFile = pFile;
+			}
+			break;
+		case FA_Memory:
+			throw Error(L"Open_AlteryxYXDB::Open: Use OpenFromMemory to read from memory.");
+		default:
+			{
+				std::shared_ptr<File_Large> pFile(new File_Large());
+				pFile->OpenForRead(strFile);
+				m_pSharedFile = pFile;
+			}
+			break;
+		}
+
+		// the OS only has the one hint for the whole file, so it is only given one the caller asked for
+		if (m_bAccessHintSet)
+			m_pSharedFile->SetAccessHint(m_accessHint);
+
+		InitRead();
+	}
+
+	void Open_AlteryxYXDB::Open(WString strFile, const std::vector<WStringNoCase> &vFields, E_FileAccess fileAccess /*= FA_Default*/)
+	{
+		SetProjection(vFields);
+		Open(strFile, fileAccess);
+	}
+
+	/*virtual*/ void Open_AlteryxYXDB::OpenFromMemory(const void *pData, size_t nSize)
+	{
+		m_fileAccess = FA_Memory;
+		std::shared_ptr<File_Memory> pFile(new File_Memory());
+		pFile->OpenForRead(pData, nSize);
+		m_pSharedFile = pFile;
+
+		InitRead();
+	}
+
+	/*virtual*/ void Open_AlteryxYXDB::OpenCursor(const Open_AlteryxYXDB &source)
+	{
+		if (!source.m_pSharedFile)
+			throw Error(L"Open_AlteryxYXDB::OpenCursor: The source file is not open for reading.");
+		if (source.m_fileAccess==FA_Stream)
+			throw Error(L"Open_AlteryxYXDB::OpenCursor: A stream can only have 1 reader.");
+
+		m_pSharedFile = source.m_pSharedFile;
+		m_fileAccess = source.m_fileAccess;
+		InitRead();
+	}
+
+	void Open_AlteryxYXDB::ParallelScan(unsigned nNumThreads, const ScanCallback &callback)
+	{
+		if (nNumThreads==0)
+			nNumThreads = std::max(1u, std::thread::hardware_concurrency());
+
+		__int64 nNumRecords = m_header.userHdr.nNumRecords;
+		__int64 nNumBlocks = nNumRecords<0 ? 1 : (nNumRecords+RecordsPerBlock-1)/RecordsPerBlock;
+		if (__int64(nNumThreads)>nNumBlocks)
+			nNumThreads = unsigned(std::max(__int64(1), nNumBlocks));
+
+		// there is nothing to hand out to other cursors, and a stream couldn't have them anyway
+		if (m_bForwardOnly || nNumBlocks<=1)
+		{
+			if (m_nCurrentRecord!=0)
+				GoRecord(0);
+			for (__int64 nRecord = 0;; nRecord++)
+			{
+				const RecordData *pRec = ReadRecord();
+				if (pRec==NULL)
+					break;
+				callback(0, m_recordInfo, nRecord, pRec);
+			}
+			return;
+		}
+
+		// every cursor is opened up front, so a file that can't be scanned this way fails before anything is read
+		std::vector<std::unique_ptr<Open_AlteryxYXDB> > vCursors;
+		for (unsigned x=0; x<nNumThreads; x++)
+		{
+			vCursors.push_back(std::unique_ptr<Open_AlteryxYXDB>(new Open_AlteryxYXDB));
+			vCursors.back()->SetBufferPool(m_pBufferPool);
+			vCursors.back()->SetVerifyChecksums(m_bVerifyChecksums);
+			// the callback's record is only good until it returns anyway
+			vCursors.back()->SetZeroCopy();
+			vCursors.back()->SetProjection(m_vProjectedFields);
+			vCursors.back()->OpenCursor(*this);
+			vCursors.back()->SetAccessHint(FileBase::AH_Sequential);
+		}
+
+		std::atomic<__int64> nNextBlock(0);
+		std::atomic<bool> bStop(false);
+		std::mutex mutexError;
+		std::exception_ptr pError;
+
+		auto scan = [&](unsigned nThread)
+		{
+			try
+			{
+				Open_AlteryxYXDB &cursor = *vCursors[nThread];
+				for (;;)
+				{
+					__int64 nBlock = nNextBlock++;
+					if (nBlock>=nNumBlocks || bStop)
+						break;
+
+					__int64 nRecord = nBlock*RecordsPerBlock;
+					__int64 nEnd = nNumRecords<0 ? -1 : std::min(nRecord+RecordsPerBlock, nNumRecords);
+					if (nRecord!=0)
+						cursor.GoRecord(nRecord);
+					for (; nRecord!=nEnd && !bStop; nRecord++)
+					{
+						const RecordData *pRec = cursor.ReadRecord();
+						if (pRec==NULL)
+							break;
+						callback(nThread, cursor.m_recordInfo, nRecord, pRec);
+					}
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(mutexError);
+				if (!pError)
+					pError = std::current_exception();
+				bStop = true;
+			}
+		};
+
+		// the calling thread does its share
+		std::vector<std::thread> vThreads;
+		try
+		{
+			for (unsigned x=1; x<nNumThreads; x++)
+				vThreads.push_back(std::thread(scan, x));
+		}
+		catch (...)
+		{
+			bStop = true;
+			for (size_t x=0; x<vThreads.size(); x++)
+				vThreads[x].join();
+			throw Error(L"Open_AlteryxYXDB::ParallelScan: Unable to start the threads.");
+		}
+		scan(0);
+		for (size_t x=0; x<vThreads.size(); x++)
+			vThreads[x].join();
+
+		if (pError)
+			std::rethrow_exception(pError);
+	}
+
+	void Open_AlteryxYXDB::InitRead()
+	{
+		if (m_fileAccess==FA_ReadAhead)
+		{
+			// read ahead needs a real file to read from
+			std::shared_ptr<File_Large> pLarge = std::dynamic_pointer_cast<File_Large>(m_pSharedFile);
+			if (!pLarge)
+				throw Error(L"Open_AlteryxYXDB: FA_ReadAhead can only be used on a file on disk.");
+			m_pFile.reset(new File_ReadAhead(pLarge));
+		}
+		else
+			m_pFile.reset(new File_Cursor(m_pSharedFile));
+
+		m_header.Read(*m_pFile);
+
+		if (!m_bAccessHintSet)
+		{
+			m_accessHint = FileBase::AH_Sequential;
+			m_nBlockJumps = 0;
+		}
+
+		if (m_header.userHdr.nFormatFlags & FF_StreamTrailer)
+			ReadStreamTrailer();
+		m_bForwardOnly = m_fileAccess==FA_Stream || m_header.userHdr.nNumRecords<0 || m_header.userHdr.nRecordBlockIndexPos<=0;
+
+		m_bIndexStartsBlock = (m_header.fileID & 0xff) == 3;
+		if (m_header.userHdr.nCompressionVersion!=0)
+		{
+			// a file that was written as a stream, but is missing its trailer, ends at the end marker instead
+			__int64 nEndPos = m_header.userHdr.nNumRecords>=0 ? m_header.userHdr.nRecordBlockIndexPos : -1;
+			m_pCompressInput.reset(new LZFBufferedInput<FileBase * >(m_pFile.get(), m_nDecompressionThreads, nEndPos, BlockCodec(E_BlockCodec(m_header.userHdr.nCompressionVersion)), m_header.GetBlockSize(), m_pBufferPool));
+			m_pCompressInput->SetChecksums((m_header.userHdr.nFormatFlags & FF_BlockChecksum)!=0, m_bVerifyChecksums);
+		}
+		else
+		{
+			// without a record block index the records go to the end of the file (-1 if that isn't known either)
+			__int64 nEndPos = m_header.userHdr.nRecordBlockIndexPos>0 ? m_header.userHdr.nRecordBlockIndexPos : m_pFile->GetSize();
+			m_pBufferedInput.reset(new BufferedInput<FileBase * >(m_pFile.get(), nEndPos));
+		}
+
+		String strRecordInfoXml;
+		wchar_t * pRecordInfoXml = strRecordInfoXml.Lock(m_header.userHdr.nMetaInfoLen);
+		m_pFile->Read(pRecordInfoXml, m_header.userHdr.nMetaInfoLen*sizeof(wchar_t));
+		strRecordInfoXml.Unlock();
+
+		m_recordInfo.InitFromXml(strRecordInfoXml);
+		InitProjection();
+		m_pRecord = m_recordInfo.CreateRecord();
+
+		// make sure we are at the first record in the file
+		assert(	m_pFile->Tell() == int(sizeof(m_header) + m_header.userHdr.nMetaInfoLen*sizeof(wchar_t)));
+	}
+	
+	// a file written as a stream has the real nNumRecords and nRecordBlockIndexPos in a copy of the header at the very end.
+	// If the file can't tell us where the end is, or the trailer isn't there (yet), the records are read until the end marker
+	void Open_AlteryxYXDB::ReadStreamTrailer()
+	{
+		m_header.userHdr.nNumRecords = -1;
+
+		__int64 nSize = m_pFile->GetSize();
+		if (nSize<__int64(2*sizeof(m_header)))
+			return;
+
+		Header trailer;
+		m_pFile->ReadAt(nSize-sizeof(trailer), &trailer, sizeof(trailer));
+		if (memcmp(trailer.fileDesc, m_header.fileDesc, sizeof(trailer.fileDesc))==0
+			&& trailer.fileID==m_header.fileID
+			&& trailer.userHdr.nFormatFlags==m_header.userHdr.nFormatFlags
+			&& trailer.userHdr.nNumRecords>=0
+			&& trailer.userHdr.nRecordBlockIndexPos>0 && trailer.userHdr.nRecordBlockIndexPos<nSize)
+		{
+			m_header.userHdr.nNumRecords = trailer.userHdr.nNumRecords;
+			m_header.userHdr.nRecordBlockIndexPos = trailer.userHdr.nRecordBlockIndexPos;
+			m_header.userHdr.nBlockDirectoryPos = trailer.userHdr.nBlockDirectoryPos;
+		}
+	}
+
+	/*static*/ bool Open_AlteryxYXDB::VerifyChecksums(WString strFile, E_FileAccess fileAccess /*= FA_Default*/)
+	{
+		Open_AlteryxYXDB file;
+		file.Open(strFile, fileAccess);
+		if (!file.m_pCompressInput.get() || (file.m_header.userHdr.nFormatFlags & FF_BlockChecksum)==0)
+			return false;
+
+		// Open leaves the file at the 1st block
+		file.m_pCompressInput->VerifyBlocks();
+		return true;
+	}
+
+	/*static*/ void Open_AlteryxYXDB::FinalizeStream(WString strFile)
+	{
+		File_Large file;
+		file.OpenForUpdate(strFile);
+
+		Header header;
+		header.Read(file);
+		if ((header.userHdr.nFormatFlags & FF_StreamTrailer)==0)
+			return; // already a regular file
+
+		__int64 nSize = file.GetSize();
+		Header trailer;
+		if (nSize>=__int64(2*sizeof(trailer)))
+			file.ReadAt(nSize-sizeof(trailer), &trailer, sizeof(trailer));
+		if (memcmp(trailer.fileDesc, header.fileDesc, sizeof(trailer.fileDesc))!=0 || trailer.fileID!=header.fileID
+			|| (trailer.userHdr.nFormatFlags & FF_StreamTrailer)==0 || trailer.userHdr.nNumRecords<0)
+		{
+			throw Error(strFile + L" \nThe stream trailer is missing.  The file was not completely written.");
+		}
+
+		// the trailer stays where it is - a regular reader never looks past the block index
+		trailer.userHdr.nFormatFlags &= ~unsigned(FF_StreamTrailer);
+		trailer.SetFileID();
+		file.WriteAt(0, &trailer, sizeof(trailer));
+		file.Close();
+	}
+
+	/*virtual*/ WString Open_AlteryxYXDB::GetRecordXmlMetaData()
+	{
+		return m_recordInfo.GetRecordXmlMetaData();
+	}
+
+	// with SetProjection, moves the file's RecordInfo to m_fileRecordInfo and replaces it with just the projected fields
+	void Open_AlteryxYXDB::InitProjection()
+	{
+		m_pProjection = NULL;
+		m_pFileRecord = NULL;
+		m_bProjectVarData = false;
+		if (m_vProjectedFields.empty())
+			return;
+
+		m_fileRecordInfo = std::move(m_recordInfo);
+		m_recordInfo = RecordInfo();
+
+		m_pProjection = new RecordCopier(m_recordInfo, m_fileRecordInfo);
+		for (unsigned x=0; x<m_vProjectedFields.size(); x++)
+		{
+			int nField = m_fileRecordInfo.GetFieldNum(m_vProjectedFields[x]);
+			const FieldBase *pField = m_fileRecordInfo[nField];
+			m_recordInfo.AddField(pField->Copy());
+			m_pProjection->Add(x, nField);
+			if (pField->m_bIsVarLength)
+				m_bProjectVarData = true;
+		}
+		m_pProjection->DoneAdding();
+		m_pFileRecord = m_fileRecordInfo.CreateRecord();
+	}
+
+	// reads the next record of the file and copies the projected fields out of it
+	const RecordData * Open_AlteryxYXDB::ReadProjectedRecord()
+	{
+		Record * pRec = m_pRecord.Get();
+		pRec->Reset();
+
+		if (m_pCompressInput.get())
+		{
+			if (!m_bProjectVarData)
+			{
+				// only the fixed part is needed.  It is used in place if it is all in the current block,
+				// and the var data is skipped over without being copied anywhere
+				unsigned nFixedSize = m_fileRecordInfo.GetFixedRecordSize();
+				unsigned nReadSize = nFixedSize;
+				if (m_fileRecordInfo.ContainsVarData())
+					nReadSize += sizeof(int);
+
+				unsigned nAvailable = 0;
+				const char *pData = static_cast<const char *>(m_pCompressInput->Peek(nAvailable));
+				if (pData==NULL || nAvailable<nReadSize)
+				{
+					m_vProjectionBuffer.resize(nReadSize);
+					m_pCompressInput->Read(&m_vProjectionBuffer[0], nReadSize);
+					pData = &m_vProjectionBuffer[0];
+				}
+				else
+					m_pCompressInput->Skip(nReadSize);
+
+				m_pProjection->Copy(pRec, reinterpret_cast<const RecordData *>(pData));
+
+				if (m_fileRecordInfo.ContainsVarData())
+				{
+					int nVarDataSize;
+					memcpy(&nVarDataSize, pData+nFixedSize, sizeof(int));
+					if (nVarDataSize<0)
+						throw Error(L"Open_AlteryxYXDB: corrupt record");
+					m_pCompressInput->Skip(unsigned(nVarDataSize));
+				}
+				return pRec->GetRecord();
+			}
+
+			const RecordData *pInPlace = GetRecordInPlace(m_fileRecordInfo);
+			if (pInPlace)
+			{
+				m_pProjection->Copy(pRec, pInPlace);
+				return pRec->GetRecord();
+			}
+		}
+
+		if (m_header.userHdr.nCompressionVersion!=0)
+			m_fileRecordInfo.Read(*m_pCompressInput, m_pFileRecord.Get());
+		else
+			m_fileRecordInfo.Read(*m_pBufferedInput, m_pFileRecord.Get());
+		m_pProjection->Copy(pRec, m_pFileRecord->GetRecord());
+		return pRec->GetRecord();
+	}
+
+	// gets ready to read the next record.  false at the end of the file
+	bool Open_AlteryxYXDB::NextRecord()
+	{
+		if (m_nCurrentRecord==m_header.userHdr.nNumRecords)
+			return false;
+
+		if ((m_nCurrentRecord % RecordsPerBlock)==0)
+			GoBlockRecord(m_nCurrentRecord);
+
+		// a stream with no count - the records go up to the end marker
+		if (m_header.userHdr.nNumRecords<0 && m_pCompressInput.get() && m_pCompressInput->IsEnd())
+		{
+			m_header.userHdr.nNumRecords = m_nCurrentRecord;
+			return false;
+		}
+
+		m_nCurrentRecord++;
+		return true;
+	}
+
+	/*virtual*/ const RecordData * Open_AlteryxYXDB::ReadRecord()
+	{
+		if (!NextRecord())
+			return NULL;
+
+		if (m_pProjection.Get())
+			return ReadProjectedRecord();
+
+		if (m_bZeroCopy && m_pCompressInput.get())
+		{
+			const RecordData *pInPlace = GetRecordInPlace(m_recordInfo);
+			if (pInPlace)
+				return pInPlace;
+		}
+
+		Record * pRec = m_pRecord.Get();
+		pRec->Reset();
+			
+		if (m_header.userHdr.nCompressionVersion!=0)
+			m_recordInfo.Read(*m_pCompressInput, pRec);
+		else
+			m_recordInfo.Read(*m_pBufferedInput, pRec);
+
+		return pRec->GetRecord();
+	}
+
+	// the next record where it is in the decompressed block, if it is all there.
+	// NULL (without reading anything) if it crosses into the next block
+	const RecordData * Open_AlteryxYXDB::GetRecordInPlace(const RecordInfo &recordInfo)
+	{
+		unsigned nAvailable = 0;
+		const char *pData = static_cast<const char *>(m_pCompressInput->Peek(nAvailable));
+
+		size_t nLen = recordInfo.GetFixedRecordSize();
+		if (recordInfo.ContainsVarData())
+			nLen += sizeof(int);
+		if (pData==NULL || nAvailable<nLen)
+			return NULL;
+
+		if (recordInfo.ContainsVarData())
+		{
+			int nVarDataSize;
+			memcpy(&nVarDataSize, pData+recordInfo.GetFixedRecordSize(), sizeof(int));
+			if (nVarDataSize<0 || nAvailable-nLen<unsigned(nVarDataSize))
+				return NULL;
+			nLen += nVarDataSize;
+		}
+
+		m_pCompressInput->Skip(unsigned(nLen));
+		return reinterpret_cast<const RecordData *>(pData);
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	// RecordBatch
+
+	template <class TFile> bool RecordBatch::ReadFrom(const RecordInfo &recordInfo, TFile &file)
+	{
+		size_t nStart = (m_nArenaLen + Alignment-1) & ~(Alignment-1);
+		size_t nReadSize = recordInfo.GetFixedRecordSize();
+		if (recordInfo.ContainsVarData())
+			nReadSize += sizeof(int);
+		if (file.Read(Grow(nStart, nReadSize), unsigned(nReadSize))!=nReadSize)
+			return false;
+
+		size_t nEnd = nStart + nReadSize;
+		if (recordInfo.ContainsVarData())
+		{
+			int nVarDataSize;
+			memcpy(&nVarDataSize, &m_vArena[nStart+recordInfo.GetFixedRecordSize()], sizeof(int));
+			if (nVarDataSize<0 || unsigned(nVarDataSize)>MaxFieldLength)
+				throw Error(L"Open_AlteryxYXDB: corrupt record");
+			if (file.Read(Grow(nEnd, nVarDataSize), unsigned(nVarDataSize))!=unsigned(nVarDataSize))
+				return false;
+			nEnd += nVarDataSize;
+		}
+
+		// only now is the record all there, so a short read above leaves the batch as it was
+		m_vOffsets.push_back(nStart);
+		m_nArenaLen = nEnd;
+		return true;
+	}
+
+	bool RecordBatch::Read(const RecordInfo &recordInfo, LZFBufferedInput<FileBase *> &file)
+	{
+		return ReadFrom(recordInfo, file);
+	}
+
+	bool RecordBatch::Read(const RecordInfo &recordInfo, BufferedInput<FileBase *> &file)
+	{
+		return ReadFrom(recordInfo, file);
+	}
+
+	size_t Open_AlteryxYXDB::ReadRecords(RecordBatch &r_batch, size_t nMaxRecords)
+	{
+		r_batch.Clear(m_nCurrentRecord);
+		if (m_pProjection.Get())
+		{
+			while (r_batch.size()<nMaxRecords && NextRecord())
+				r_batch.Add(m_recordInfo, ReadProjectedRecord());
+		}
+		else
+		{
+			while (r_batch.size()<nMaxRecords && NextRecord())
+			{
+				bool bRead = m_header.userHdr.nCompressionVersion!=0 ? r_batch.Read(m_recordInfo, *m_pCompressInput) : r_batch.Read(m_recordInfo, *m_pBufferedInput);
+				if (!bRead)
+				{
+					m_nCurrentRecord--;
+					throw Error(L"Open_AlteryxYXDB::ReadRecords: The file ends partway through a record.  The file is corrupt.");
+				}
+			}
+		}
+		return r_batch.size();
+	}
+
+	size_t Open_AlteryxYXDB::ReadColumns(ColumnBatch &r_columns, size_t nMaxRecords /*= RecordsPerBlock*/)
+	{
+		ReadRecords(m_columnRecords, nMaxRecords);
+		r_columns.Decode(m_recordInfo, m_columnRecords);
+		return r_columns.size();
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	// ColumnBatch
+	// these all work straight off the record layout - see the GetVal's in FieldTypes.h.
+	// The fields aren't necessarily aligned in the record, so everything is memcpy'd out
+	namespace {
+		inline void SetValid(ColumnBatch::Column &column, size_t nRow, bool bValid)
+		{
+			if (bValid)
+				column.vValidity[nRow>>3] |= (unsigned char)(1 << (nRow&7));
+			else
+				column.nNullCount++;
+		}
+
+		// Field_Num: the value followed by a NULL flag byte
+		template <class T_Num, class T_Dest> void DecodeNum(ColumnBatch::Column &column, std::vector<T_Dest> &r_vDest, int nOffset, const RecordBatch &batch)
+		{
+			r_vDest.resize(batch.size());
+			for (size_t nRow=0; nRow<batch.size(); nRow++)
+			{
+				const char *pField = ToCharP(batch[nRow]) + nOffset;
+				T_Num val;
+				memcpy(&val, pField, sizeof(val));
+				bool bValid = pField[sizeof(T_Num)]==0;
+				r_vDest[nRow] = bValid ? T_Dest(val) : T_Dest(0);
+				SetValid(column, nRow, bValid);
+			}
+		}
+
+		// Field_String: nSize chars, 0 terminated if shorter, followed by a NULL flag byte
+		template <class TChar> void DecodeString(ColumnBatch::Column &column, int nOffset, unsigned nSize, const RecordBatch &batch)
+		{
+			for (size_t nRow=0; nRow<batch.size(); nRow++)
+			{
+				const char *pField = ToCharP(batch[nRow]) + nOffset;
+				bool bValid = pField[nSize*sizeof(TChar)]==0;
+				if (bValid)
+				{
+					unsigned nLen = 0;
+					for (; nLen<nSize; nLen++)
+					{
+						TChar c;
+						memcpy(&c, pField+nLen*sizeof(TChar), sizeof(c));
+						if (c==0)
+							break;
+					}
+					column.vData.insert(column.vData.end(), pField, pField+nLen*sizeof(TChar));
+				}
+				column.vOffsets[nRow+1] = __int64(column.vData.size());
+				SetValid(column, nRow, bValid);
+			}
+		}
+
+		// V_String, V_WString, Blob and SpatialObj all live in the var data
+		void DecodeVarData(ColumnBatch::Column &column, int nOffset, const RecordBatch &batch)
+		{
+			for (size_t nRow=0; nRow<batch.size(); nRow++)
+			{
+				BlobVal val = RecordInfo::GetVarDataValue(batch[nRow], nOffset);
+				bool bValid = val.pValue!=NULL;
+				if (bValid)
+					column.vData.insert(column.vData.end(), static_cast<const char *>(val.pValue), static_cast<const char *>(val.pValue)+val.nLength);
+				column.vOffsets[nRow+1] = __int64(column.vData.size());
+				SetValid(column, nRow, bValid);
+			}
+		}
+	}
+
+	void ColumnBatch::Decode(const RecordInfo &recordInfo, const RecordBatch &batch)
+	{
+		m_nNumRows = batch.size();
+		m_nFirstRecord = batch.GetFirstRecord();
+		m_vColumns.resize(recordInfo.NumFields());
+
+		for (unsigned nField=0; nField<recordInfo.NumFields(); nField++)
+		{
+			const FieldBase *pField = recordInfo[nField];
+			Column &column = m_vColumns[nField];
+			column.nField = nField;
+			column.nNullCount = 0;
+			column.vValidity.assign((m_nNumRows+7)/8, 0);
+			column.vInt64.clear();
+			column.vDouble.clear();
+			column.vBits.clear();
+			column.vOffsets.clear();
+			column.vData.clear();
+
+			switch (pField->m_ft)
+			{
+				case E_FT_Bool:
+					column.type = CT_Bool;
+					column.vBits.assign((m_nNumRows+7)/8, 0);
+					for (size_t nRow=0; nRow<m_nNumRows; nRow++)
+					{
+						// bit 1 is the NULL flag, bit 0 the value
+						char c = *(ToCharP(batch[nRow]) + pField->GetOffset());
+						bool bValid = (c & 2)==0;
+						if (bValid && (c & 1))
+							column.vBits[nRow>>3] |= (unsigned char)(1 << (nRow&7));
+						SetValid(column, nRow, bValid);
+					}
+					break;
+				case E_FT_Byte:
+					column.type = CT_Int64;
+					DecodeNum<unsigned char>(column, column.vInt64, pField->GetOffset(), batch);
+					break;
+				case E_FT_Int16:
+					column.type = CT_Int64;
+					DecodeNum<signed short>(column, column.vInt64, pField->GetOffset(), batch);
+					break;
+				case E_FT_Int32:
+					column.type = CT_Int64;
+					DecodeNum<signed int>(column, column.vInt64, pField->GetOffset(), batch);
+					break;
+				case E_FT_Int64:
+					column.type = CT_Int64;
+					DecodeNum<signed __int64>(column, column.vInt64, pField->GetOffset(), batch);
+					break;
+				case E_FT_Float:
+					column.type = CT_Double;
+					DecodeNum<float>(column, column.vDouble, pField->GetOffset(), batch);
+					break;
+				case E_FT_Double:
+					column.type = CT_Double;
+					DecodeNum<double>(column, column.vDouble, pField->GetOffset(), batch);
+					break;
+				case E_FT_String:
+				case E_FT_Date:
+				case E_FT_Time:
+				case E_FT_DateTime:
+				case E_FT_FixedDecimal:
+					column.type = CT_String;
+					column.vOffsets.assign(m_nNumRows+1, 0);
+					DecodeString<char>(column, pField->GetOffset(), pField->m_nSize, batch);
+					break;
+				case E_FT_WString:
+					column.type = CT_WString;
+					column.vOffsets.assign(m_nNumRows+1, 0);
+					DecodeString<wchar_t>(column, pField->GetOffset(), pField->m_nSize, batch);
+					break;
+				case E_FT_V_String:
+				case E_FT_V_WString:
+				case E_FT_Blob:
+				case E_FT_SpatialObj:
+					column.type = pField->m_ft==E_FT_V_String ? CT_String : pField->m_ft==E_FT_V_WString ? CT_WString : CT_Binary;
+					column.vOffsets.assign(m_nNumRows+1, 0);
+					DecodeVarData(column, pField->GetOffset(), batch);
+					break;
+				default:
+					throw Error(L"ColumnBatch::Decode: The field \"" + pField->GetFieldName() + L"\" has an unknown type.");
+			}
+		}
+	}
+
+	/*virtual*/ __int64 Open_AlteryxYXDB::GetNumRecords()
+	{
+		return m_header.userHdr.nNumRecords;
+	}
+
+
+	void Open_AlteryxYXDB::LoadRecordBlockIndex()
+	{
+		if (m_vRecordBlockIndexPos.size()==0)
+		{
+			// read the index without moving the file position, so a sequential scan doesn't lose its read ahead
+			unsigned nNewArraySize=0;
+			m_pFile->ReadAt(m_header.userHdr.nRecordBlockIndexPos, &nNewArraySize, sizeof(nNewArraySize));
+			m_vRecordBlockIndexPos.resize(nNewArraySize);
+			
+			if (nNewArraySize!=0)
+				m_pFile->ReadAt(m_header.userHdr.nRecordBlockIndexPos+sizeof(nNewArraySize), &*m_vRecordBlockIndexPos.begin(), nNewArraySize*sizeof(__int64));
+		}
+	}
+
+	void Open_AlteryxYXDB::LoadBlockDirectory()
+	{
+		if (m_bBlockDirectoryLoaded)
+			return;
+		m_bBlockDirectoryLoaded = true;
+
+		// a stream that hasn't got to its trailer doesn't know where the directory is yet
+		if ((m_header.userHdr.nFormatFlags & FF_BlockDirectory)==0 || m_bForwardOnly)
+			return;
+
+		unsigned nNumBlocks = 0;
+		m_pFile->ReadAt(m_header.userHdr.nBlockDirectoryPos, &nNumBlocks, sizeof(nNumBlocks));
+		m_vBlockDirectory.resize(nNumBlocks);
+		if (nNumBlocks!=0)
+			m_pFile->ReadAt(m_header.userHdr.nBlockDirectoryPos+sizeof(nNumBlocks), &m_vBlockDirectory[0], unsigned(nNumBlocks*sizeof(LZFBlockEntry)));
+	}
+
+	const std::vector<LZFBlockEntry> & Open_AlteryxYXDB::GetBlockDirectory()
+	{
+		LoadBlockDirectory();
+		return m_vBlockDirectory;
+	}
+
+	// the last block that nRecord or a record before it starts in.  NULL if there is no block directory
+	const LZFBlockEntry * Open_AlteryxYXDB::FindBlockEntry(__int64 nRecord)
+	{
+		LoadBlockDirectory();
+
+		// nFirstRecord only ever goes up.  A block that no record starts in has the next one that does
+		std::vector<LZFBlockEntry>::const_iterator it = std::upper_bound(m_vBlockDirectory.begin(), m_vBlockDirectory.end(), nRecord,
+			[](__int64 n, const LZFBlockEntry &entry) { return n<entry.nFirstRecord; });
+		while (it!=m_vBlockDirectory.begin())
+		{
+			--it;
+			if (it->nFirstRecordOffset<it->nSize)
+				return &*it;
+		}
+		return NULL;
+	}
+
+	void Open_AlteryxYXDB::ReadBlock(size_t nBlock, std::vector<unsigned char> &r_vData)
+	{
+		LoadBlockDirectory();
+		if (nBlock>=m_vBlockDirectory.size())
+			throw Error(L"Open_AlteryxYXDB::ReadBlock: The block is past the end of the block directory.");
+
+		unsigned nBlockSize = m_header.GetBlockSize();
+		r_vData.resize(nBlockSize);
+		std::vector<unsigned char> vIn;
+		unsigned nSize = LZFReadBlockAt(m_pFile.get(), m_vBlockDirectory[nBlock].nPos, nBlockSize,
+			BlockCodec(E_BlockCodec(m_header.userHdr.nCompressionVersion)), (m_header.userHdr.nFormatFlags & FF_BlockChecksum)!=0, vIn, &r_vData[0]);
+		if (nSize!=m_vBlockDirectory[nBlock].nSize)
+			throw Error(L"Open_AlteryxYXDB::ReadBlock: The block does not match the block directory.");
+		r_vData.resize(nSize);
+	}
+
+	// lets the OS start reading the start of a record block, since we know exactly where it is.
+	// A whole block can be hundreds of MB, most of which would be pushed out of the page cache again
+	// before a scan got to it - or never be read at all by a random read - so it only asks for so much
+	void Open_AlteryxYXDB::WillNeedBlock(unsigned nBlock)
+	{
+		if (nBlock>=m_vRecordBlockIndexPos.size())
+			return;
+
+		const __int64 SequentialWillNeedSize = 0x400000;
+		const __int64 RandomWillNeedSize = LZFDefaultBlockSize;
+
+		__int64 nEnd = nBlock+1<m_vRecordBlockIndexPos.size() ? m_vRecordBlockIndexPos[nBlock+1] : m_header.userHdr.nRecordBlockIndexPos;
+		__int64 nSize = std::min(nEnd-m_vRecordBlockIndexPos[nBlock], m_accessHint==FileBase::AH_Random ? RandomWillNeedSize : SequentialWillNeedSize);
+		m_pFile->WillNeed(m_vRecordBlockIndexPos[nBlock], nSize);
+	}
+
+	void Open_AlteryxYXDB::GoBlockRecord(__int64 nRecord)
+	{
+		// a stream is only ever read straight through, and each block starts right where the last one ended.
+		// (the block index is at the end, so it couldn't be read yet anyway)
+		if (m_bForwardOnly)
+			return;
+
+		unsigned nBlock = unsigned(nRecord/RecordsPerBlock);
+		if (nRecord==0)
+		{
+			m_pFile->LSeek(sizeof(m_header) + m_header.userHdr.nMetaInfoLen*sizeof(wchar_t));
+			if (m_pCompressInput.get())
+				m_pCompressInput->Reset();
+			if (m_pBufferedInput.get())
+				m_pBufferedInput->Reset();
+			m_nCurrentRecord = 0;
+		}
+		else
+		{
+			LoadRecordBlockIndex();
+			__int64 nNewPos = m_vRecordBlockIndexPos[nBlock];
+
+			// a scan with the decompression threads is already there, and seeking would throw away its read ahead
+			if (!m_pCompressInput.get() || !m_pCompressInput->IsAtBlock(nNewPos))
+			{
+				m_pFile->LSeek(nNewPos);
+				if (m_pCompressInput.get())
+					m_pCompressInput->Reset();
+				if (m_pBufferedInput.get())
+					m_pBufferedInput->Reset();
+			}
+		}
+
+		// a sequential scan asks for the next block while it reads this one, a random read only needs this one
+		if (m_header.userHdr.nNumRecords>RecordsPerBlock)
+		{
+			LoadRecordBlockIndex();
+			WillNeedBlock(m_accessHint==FileBase::AH_Random ? nBlock : nBlock+1);
+		}
+	}
+
+	void Open_AlteryxYXDB::SetAccessHint(FileBase::E_AccessHint hint)
+	{
+		m_accessHint = hint;
+		m_bAccessHintSet = true;
+	}
+
+	/*virtual*/ void Open_AlteryxYXDB::GoRecord(__int64 nRecord /*= 0*/)
+	{
+		if ((m_header.userHdr.nNumRecords>=0 && nRecord>=m_header.userHdr.nNumRecords) || nRecord<0)
+			throw Error(L"Open_AlteryxYXDB::GoRecord: Attempt to seek past the end of the file");
+		else if (nRecord==m_nCurrentRecord)
+			; // do nothing
+		else if (m_bForwardOnly)
+		{
+			if (nRecord<m_nCurrentRecord)
+				throw Error(L"Open_AlteryxYXDB::GoRecord: A stream can't go back to an earlier record");
+
+			while (m_nCurrentRecord<nRecord)
+			{
+				if (!ReadRecord())
+					throw Error(L"Open_AlteryxYXDB::GoRecord: Attempt to seek past the end of the file");
+			}
+		}
+		else
+		{
+			// with a block directory, the record can be read from the start of its compressed block
+			const LZFBlockEntry *pEntry = m_pCompressInput.get() ? FindBlockEntry(nRecord) : NULL;
+
 			unsigned numSkipRecs = 0;
-			if (nRecord>m_nCurrentRecord && nRecord<(m_nCurrentRecord + RecordsPerBlock - (m_nCurrentRecord % RecordsPerBlock)))
+			if (nRecord>m_nCurrentRecord && nRecord<(m_nCurrentRecord + RecordsPerBlock - (m_nCurrentRecord % RecordsPerBlock))
+				&& (pEntry==NULL || m_nCurrentRecord>=pEntry->nFirstRecord))
+			{
 				numSkipRecs = unsigned(nRecord-m_nCurrentRecord);
+			}
 			else
 			{
-				// read record will reset to the correct spot when it tries to read the next record
-				numSkipRecs = unsigned(nRecord % RecordsPerBlock);
-				m_nCurrentRecord = nRecord-numSkipRecs;
+				if (pEntry && (pEntry->nFirstRecord % RecordsPerBlock)!=0)
+				{
+					m_pFile->LSeek(pEntry->nPos);
+					m_pCompressInput->Reset();
+					m_pCompressInput->Skip(pEntry->nFirstRecordOffset);
+					numSkipRecs = unsigned(nRecord-pEntry->nFirstRecord);
+					m_nCurrentRecord = pEntry->nFirstRecord;
+				}
+				else
+				{
+					// read record will reset to the correct spot when it tries to read the next record
+					numSkipRecs = unsigned(nRecord % RecordsPerBlock);
+					m_nCurrentRecord = nRecord-numSkipRecs;
+				}
+
+				// a few jumps between blocks means reading ahead into the next block is just wasted I/O.
+				// This only changes what this reader asks for - the file may have other cursors still scanning it
+				const unsigned RandomAccessJumps = 4;
+				if (!m_bAccessHintSet && m_accessHint!=FileBase::AH_Random && ++m_nBlockJumps>=RandomAccessJumps)
+					m_accessHint = FileBase::AH_Random;
 			}
 
 			for (unsigned x=0; x<numSkipRecs; x++)
@@ -15,29 +15,140 @@
 #include "lzf_src.h "
 #include "Record.h"
 #include <time.h>
+#include <functional>
 
 namespace Alteryx  { namespace OpenYXDB
 {
 	using namespace SRC;
 
+	///////////////////////////////////////////////////////////////////////////////
+	// class FileBase
+	// 
+	// the file interface that Open_AlteryxYXDB and the LZF buffers need
+	class FileBase
+	{
+	public:
+		enum E_AccessHint
+		{
+			AH_Normal,
+			AH_Sequential,	// reading forward through the file
+			AH_Random,		// jumping around - read ahead would be wasted
+		};
+
+		virtual ~FileBase()
+		{
+		}
+		virtual void Close() = 0;
+
+		virtual WString GetFileName() const = 0;
+		virtual bool IsOpen() const = 0;
+
+		virtual __int64 Tell() const = 0;
+
+		virtual void LSeek(__int64 nPos) = 0;
+
+		virtual unsigned Read(void * _pBuffer, unsigned nNumBytesToRead) = 0;
+
+		virtual unsigned Write(const void * _pBuffer, unsigned nNumBytesToWrite) = 0;
+
+		// writes at nPos and then puts the file position back where it was
+		virtual unsigned WriteAt(__int64 nPos, const void * _pBuffer, unsigned nNumBytesToWrite)
+		{
+			__int64 nOldPos = Tell();
+			LSeek(nPos);
+			unsigned ret = Write(_pBuffer, nNumBytesToWrite);
+			LSeek(nOldPos);
+			return ret;
+		}
+
+		// if the file already has its data in memory, this returns a pointer to the next
+		// nNumBytes and advances past them - like a Read without the copy.
+		// The pointer is only guaranteed to be valid until the next call on the file.
+		// returns NULL if not supported, in which case the caller needs to Read instead
+		virtual const void * Get(unsigned /*nNumBytes*/)
+		{
+			return NULL;
+		}
+
+		// positional versions of Read and Get.  These neither use nor change the file position,
+		// so any number of threads can be reading the same open file this way at once
+		virtual unsigned ReadAt(__int64 nPos, void * _pBuffer, unsigned nNumBytesToRead) = 0;
+		virtual const void * GetAt(__int64 /*nPos*/, unsigned /*nNumBytes*/)
+		{
+			return NULL;
+		}
+
+		// hints for the OS about how the file will be read.  They are just hints, so the default ignores them.
+		// The access hint is for the whole open file, whoever is reading it
+		virtual void SetAccessHint(E_AccessHint /*hint*/)
+		{
+		}
+		// the range is going to be read soon
+		virtual void WillNeed(__int64 /*nPos*/, __int64 /*nSize*/)
+		{
+		}
+
+		// -1 if the size isn't known (a stream)
+		virtual __int64 GetSize() const
+		{
+			return -1;
+		}
+	};
+
+	// lets LZFBufferedInput decompress straight out of a FileBase that supports Get
+	inline const void * LZFGetInPlace(FileBase * pFile, unsigned nSize)
+	{
+		return pFile->Get(nSize);
+	}
+	// and lets LZFReadBlockAt do the same
+	inline const void * LZFGetAtInPlace(FileBase * pFile, __int64 nPos, unsigned nSize)
+	{
+		return pFile->GetAt(nPos, nSize);
+	}
+
 	///////////////////////////////////////////////////////////////////////////////
 	// class File_Large
 	// 
-	class File_Large
+	class File_Large : public FileBase
 	{
 		WString m_strFile;
 		int m_iFileDescriptor;
 
+		// direct I/O: writes are staged in an aligned buffer and written around the page cache.
+		// m_nDirectBufferPos is where in the file the start of m_pDirectBuffer goes
+		enum { DirectIOAlignment = 0x1000, DirectIOBufferSize = 0x100000 };
+		unsigned char *m_pDirectBuffer;
+		unsigned m_nDirectBufferUsed;
+		__int64 m_nDirectBufferPos;
+		bool m_bDirectIOFlag;
+
+		bool m_bPreallocated;
+
+		void FlushDirectBuffer(bool bAll);
+		void SetDirectIOFlag(bool bDirectIO);
+		unsigned WriteAtRaw(__int64 nPos, const void * _pBuffer, unsigned nNumBytesToWrite, bool bDirectIO);
+		void EndDirectIO();
+
+		File_Large(const File_Large &);
+		File_Large & operator =(const File_Large &);
 	public:
 		File_Large();
 		~File_Large();
 		void Close();
 
 		void OpenForRead(WString strFile);
-		void OpenForWrite(WString strFile);
+		// opens an existing file for reading and writing, without truncating it
+		void OpenForUpdate(WString strFile);
+		// bDirectIO keeps the written data out of the page cache (O_DIRECT) where the OS and file system allow it.
+		// It is for writing straight through: a WriteAt to anything that is no longer staged (the header rewrite
+		// at the end) finishes the direct writes, and anything after that goes through the page cache
+		void OpenForWrite(WString strFile, bool bDirectIO = false);
 
 		inline WString GetFileName() const { return m_strFile; }
 		inline bool IsOpen() const { return m_iFileDescriptor!=-1; }
+		inline int GetFileDescriptor() const { return m_iFileDescriptor; }
+
+		__int64 GetSize() const;
 
 		__int64 Tell() const;
 
@@ -47,14 +158,278 @@ namespace Alteryx  { namespace OpenYXDB
 
 		unsigned Write(const void * _pBuffer, unsigned nNumBytesToWrite);
 
+		// on Windows this moves the file position (see the .cpp), so don't mix it with Read on the same file
+		unsigned ReadAt(__int64 nPos, void * _pBuffer, unsigned nNumBytesToRead);
+
+		unsigned WriteAt(__int64 nPos, const void * _pBuffer, unsigned nNumBytesToWrite);
+
+		void SetAccessHint(E_AccessHint hint);
+		void WillNeed(__int64 nPos, __int64 nSize);
+
+		// reserves disk space for a file that is about to be written, so it doesn't get fragmented.
+		// Doesn't change the file size, and whatever isn't used is given back on Close
+		void Preallocate(__int64 nSize);
+
 		static void GetAndThrowError(WString strErrorIntro);
+#ifdef __GNUG__
+		// the file name for the POSIX calls, which can't take the characters the locale has no room for
+		static AString GetNarrowFileName(WString strFile, WString strErrorIntro);
+#endif
+	};
+
+	///////////////////////////////////////////////////////////////////////////////
+	// class File_Memory
+	// 
+	// a file that is just a block of memory.  Get hands out pointers straight into it.
+	// For reading it uses the caller's memory as is - nothing is copied, so it has to stay valid until Close.
+	// For writing it writes into the caller's vector, which grows as needed and holds the file after Close
+	class File_Memory : public FileBase
+	{
+	protected:
+		WString m_strFile;
+		const unsigned char *m_pData;
+		__int64 m_nSize;
+		__int64 m_nPos;
+		bool m_bIsOpen;
+
+		// NULL unless open for writing
+		std::vector<unsigned char> *m_pvWriteData;
+
+		File_Memory(const File_Memory &);
+		File_Memory & operator =(const File_Memory &);
+	public:
+		File_Memory();
+		~File_Memory();
+		void Close();
+
+		void OpenForRead(const void *pData, size_t nSize, WString strName = L"Memory");
+		void OpenForWrite(std::vector<unsigned char> &r_vData, WString strName = L"Memory");
+
+		inline WString GetFileName() const { return m_strFile; }
+		inline bool IsOpen() const { return m_bIsOpen; }
+		inline __int64 GetSize() const { return m_nSize; }
+
+		inline __int64 Tell() const { return m_nPos; }
+
+		void LSeek(__int64 nPos);
+
+		unsigned Read(void * _pBuffer, unsigned nNumBytesToRead);
+
+		unsigned Write(const void * _pBuffer, unsigned nNumBytesToWrite);
+
+		const void * Get(unsigned nNumBytes);
+
+		unsigned ReadAt(__int64 nPos, void * _pBuffer, unsigned nNumBytesToRead);
+		const void * GetAt(__int64 nPos, unsigned nNumBytes);
+
+		unsigned WriteAt(__int64 nPos, const void * _pBuffer, unsigned nNumBytesToWrite);
+	};
+
+	///////////////////////////////////////////////////////////////////////////////
+	// class File_MemoryMapped
+	// 
+	// read only.  The whole file is mapped into memory, so Get can hand out pointers
+	// directly into the page cache instead of copying into a buffer
+	class File_MemoryMapped : public File_Memory
+	{
+		File_MemoryMapped(const File_MemoryMapped &);
+		File_MemoryMapped & operator =(const File_MemoryMapped &);
+	public:
+		File_MemoryMapped();
+		~File_MemoryMapped();
+		void Close();
+
+		void OpenForRead(WString strFile);
+
+		void SetAccessHint(E_AccessHint hint);
+		void WillNeed(__int64 nPos, __int64 nSize);
+	};
+
+	///////////////////////////////////////////////////////////////////////////////
+	// class File_ReadAhead
+	// 
+	// read only.  Like File_Cursor, but it keeps reads of the next few chunks of the file in flight
+	// while the caller is busy with (decompressing) the current one.
+	// On Linux the reads are queued with io_uring if the kernel supports it,
+	// otherwise a background thread does them.
+	class File_ReadAhead : public FileBase
+	{
+	public:
+		// a piece of the file that is being (or has been) read ahead
+		struct Chunk
+		{
+			std::unique_ptr<unsigned char[]> pBuffer;
+			__int64 nPos;
+			unsigned nSize;
+			bool bPending;
+			WString strError;
+
+			inline Chunk()
+				: nPos(0)
+				, nSize(0)
+				, bPending(false)
+			{
+			}
+		};
+
+		// issues the actual reads
+		class Engine
+		{
+		public:
+			virtual ~Engine()
+			{
+			}
+			// starts reading the chunk in the background
+			virtual void Start(Chunk *pChunk) = 0;
+			// waits for a started chunk to finish.  Errors are put in the chunk's strError
+			virtual void Wait(Chunk *pChunk) = 0;
+		};
+
+	private:
+		std::shared_ptr<File_Large> m_pFile;
+		std::unique_ptr<Engine> m_pEngine;
+		__int64 m_nFileSize;
+		__int64 m_nPos;
+		unsigned m_nChunkSize;
+
+		// a ring of chunks covering the file from m_vChunks[m_nHead].nPos to m_nReadAheadEnd
+		std::vector<Chunk> m_vChunks;
+		unsigned m_nHead;
+		__int64 m_nReadAheadEnd;
+
+		void StartChunk(Chunk &chunk, __int64 nPos);
+		void Restart(__int64 nPos);
+		void WaitForAll();
+		const unsigned char * Fetch(__int64 nPos, unsigned &r_nAvailable);
+
+		File_ReadAhead(const File_ReadAhead &);
+		File_ReadAhead & operator =(const File_ReadAhead &);
+	public:
+		// without bIoUring the reads always go through the background thread
+		File_ReadAhead(std::shared_ptr<File_Large> pFile, unsigned nNumChunks = 4, unsigned nChunkSize = 0x40000, bool bIoUring = true);
+		~File_ReadAhead();
+		void Close();
+
+		inline WString GetFileName() const { return m_pFile ? m_pFile->GetFileName() : WString(); }
+		inline bool IsOpen() const { return m_pFile && m_pFile->IsOpen(); }
+
+		inline __int64 Tell() const { return m_nPos; }
+		inline __int64 GetSize() const { return m_nFileSize; }
+
+		void LSeek(__int64 nPos);
+
+		unsigned Read(void * _pBuffer, unsigned nNumBytesToRead);
+
+		unsigned Write(const void * _pBuffer, unsigned nNumBytesToWrite);
+
+		// only returns a pointer if all the bytes are in a single chunk
+		const void * Get(unsigned nNumBytes);
+
+		inline unsigned ReadAt(__int64 nPos, void * _pBuffer, unsigned nNumBytesToRead) { return m_pFile->ReadAt(nPos, _pBuffer, nNumBytesToRead); }
+
+		inline void SetAccessHint(E_AccessHint hint) { m_pFile->SetAccessHint(hint); }
+		inline void WillNeed(__int64 nPos, __int64 nSize) { m_pFile->WillNeed(nPos, nSize); }
+	};
+
+	///////////////////////////////////////////////////////////////////////////////
+	// class File_Cursor
+	// 
+	// read only.  Keeps its own position and reads through ReadAt/GetAt, so any number of
+	// cursors (in any number of threads) can share one open file without a lock
+	class File_Cursor : public FileBase
+	{
+		std::shared_ptr<FileBase> m_pFile;
+		__int64 m_nPos;
+
+	public:
+		File_Cursor(std::shared_ptr<FileBase> pFile, __int64 nPos = 0);
+		void Close();
+
+		inline WString GetFileName() const { return m_pFile ? m_pFile->GetFileName() : WString(); }
+		inline bool IsOpen() const { return m_pFile && m_pFile->IsOpen(); }
+
+		inline __int64 Tell() const { return m_nPos; }
+		inline __int64 GetSize() const { return m_pFile->GetSize(); }
+
+		void LSeek(__int64 nPos);
+
+		unsigned Read(void * _pBuffer, unsigned nNumBytesToRead);
+
+		unsigned Write(const void * _pBuffer, unsigned nNumBytesToWrite);
+
+		const void * Get(unsigned nNumBytes);
+
+		inline unsigned ReadAt(__int64 nPos, void * _pBuffer, unsigned nNumBytesToRead) { return m_pFile->ReadAt(nPos, _pBuffer, nNumBytesToRead); }
+		inline const void * GetAt(__int64 nPos, unsigned nNumBytes) { return m_pFile->GetAt(nPos, nNumBytes); }
+
+		// the hint would go to the shared file and change the read ahead for every cursor on it,
+		// so a cursor only passes on the ranges it is about to read
+		inline void SetAccessHint(E_AccessHint /*hint*/) { }
+		inline void WillNeed(__int64 nPos, __int64 nSize) { m_pFile->WillNeed(nPos, nSize); }
+	};
+
+	///////////////////////////////////////////////////////////////////////////////
+	// class File_Stream
+	// 
+	// forward only - a pipe, stdin, a socket, etc...  There is only the one position,
+	// so LSeek and ReadAt can skip ahead but never go back, and ReadAt moves the position.
+	// It can be written, but not with LSeek or WriteAt
+	class File_Stream : public FileBase
+	{
+		WString m_strFile;
+		int m_iFileDescriptor;
+		__int64 m_nPos;
+
+		File_Stream(const File_Stream &);
+		File_Stream & operator =(const File_Stream &);
+	public:
+		File_Stream();
+		~File_Stream();
+		void Close();
+
+		void OpenForRead(WString strFile);
+		void OpenForWrite(WString strFile);
+
+		inline WString GetFileName() const { return m_strFile; }
+		inline bool IsOpen() const { return m_iFileDescriptor!=-1; }
+
+		inline __int64 Tell() const { return m_nPos; }
+
+		void LSeek(__int64 nPos);
+
+		unsigned Read(void * _pBuffer, unsigned nNumBytesToRead);
+
+		unsigned Write(const void * _pBuffer, unsigned nNumBytesToWrite);
+
+		unsigned ReadAt(__int64 nPos, void * _pBuffer, unsigned nNumBytesToRead);
+
+		unsigned WriteAt(__int64 nPos, const void * _pBuffer, unsigned nNumBytesToWrite);
 	};
 
 	const int RecordsPerBlock = 0x10000;
-	const long ID_WRIGLEYDB = 0x00440205;
+	const long ID_WRIGLEYDB = 0x00440206;	// the newest version that can be read
 	const long ID_WRIGLEYDB_NoSpatialIndex = 0x00440204;
+	// files that need something older readers don't know about.  HeaderData::nFormatFlags says what
+	const long ID_WRIGLEYDB_Extended = 0x00440206;
 	const int HeaderPageSize = 512;
 
+	enum E_FormatFlags
+	{
+		// written to a stream: nNumRecords and nRecordBlockIndexPos weren't known when the header was written.
+		// The records end with an LZF end marker, then the block index, then a copy of the header with them filled in
+		FF_StreamTrailer = 0x1,
+		// nCompressionVersion is a codec newer than LZF - see E_BlockCodec
+		FF_BlockCodec = 0x2,
+		// the blocks were written with HeaderData::nBlockSize instead of LZFDefaultBlockSize
+		FF_BlockSize = 0x4,
+		// each block has a CRC32C after its length - see LZFBufferedOutput::SetChecksums
+		FF_BlockChecksum = 0x8,
+		// there is a directory of the compressed blocks after the record block index - see HeaderData::nBlockDirectoryPos
+		FF_BlockDirectory = 0x10,
+
+		FF_All = FF_StreamTrailer | FF_BlockCodec | FF_BlockSize | FF_BlockChecksum | FF_BlockDirectory
+	};
+
 	struct FileHeaderStruct
 	{
 		char	fileDesc[64];
@@ -71,6 +446,9 @@ namespace Alteryx  { namespace OpenYXDB
 		__int64 nRecordBlockIndexPos;
 		__int64 nNumRecords;
 		int nCompressionVersion;
+		unsigned nFormatFlags;	// E_FormatFlags - always 0 unless the fileID is ID_WRIGLEYDB_Extended
+		unsigned nBlockSize;	// only with FF_BlockSize - see GetBlockSize
+		__int64 nBlockDirectoryPos;	// only with FF_BlockDirectory.  The count, then an LZFBlockEntry for every block
 	};
 
 
@@ -86,9 +464,15 @@ namespace Alteryx  { namespace OpenYXDB
 		}
 
 
+		// only use the extended version when it is needed, so older readers can still read everything else
+		inline void SetFileID()
+		{
+			fileID = userHdr.nFormatFlags!=0 ? ID_WRIGLEYDB_Extended : ID_WRIGLEYDB_NoSpatialIndex;
+		}
+
 		template <class T_File> inline void Write(T_File &outFile)
 		{
-			fileID = ID_WRIGLEYDB_NoSpatialIndex;
+			SetFileID();
 			time_t tTemp;
 			time(&tTemp);
 			creationDate = long(tTemp);
@@ -101,6 +485,20 @@ namespace Alteryx  { namespace OpenYXDB
 		{
 			inFile.Read(this, sizeof(*this));
 			CheckFileID(inFile);
+
+			if ((fileID & 0xff) < (ID_WRIGLEYDB_Extended & 0xff))
+				userHdr.nFormatFlags = 0;
+			if ((userHdr.nFormatFlags & ~unsigned(FF_All))
+				|| unsigned(userHdr.nCompressionVersion) > unsigned((userHdr.nFormatFlags & FF_BlockCodec) ? BC_Max : BC_LZF))
+				throw Error(inFile.GetFileName() + L" \nThe file version is newer than expected.  This file cannot be read.");
+			if ((userHdr.nFormatFlags & FF_BlockSize) && (userHdr.nBlockSize<LZFMinBlockSize || userHdr.nBlockSize>LZFMaxBlockSize))
+				throw Error(inFile.GetFileName() + L" \nThe block size in the FileHeader is not valid.");
+		}
+
+		// what the LZF blocks hold before they are compressed
+		inline unsigned GetBlockSize() const
+		{
+			return (userHdr.nFormatFlags & FF_BlockSize) ? userHdr.nBlockSize : LZFDefaultBlockSize;
 		}
 
 	protected:
@@ -130,23 +528,219 @@ namespace Alteryx  { namespace OpenYXDB
 		}
 	} ;
 
+	///////////////////////////////////////////////////////////////////////////////
+	// RecordBatch
+	// a run of records read by Open_AlteryxYXDB::ReadRecords, one after another in a single block of memory
+	// with an offset for each.  Nothing in it points back into the reader, so it can be handed to another thread.
+	// Reading into the same batch again reuses its memory
+	class RecordBatch
+	{
+		// each record starts on an 8 byte boundary
+		static const size_t Alignment = 8;
+
+		std::vector<char> m_vArena;
+		size_t m_nArenaLen;
+		std::vector<size_t> m_vOffsets;
+		__int64 m_nFirstRecord;
+
+		inline char * Grow(size_t nStart, size_t nLen)
+		{
+			if (m_vArena.size() < nStart+nLen)
+				m_vArena.resize(std::max(nStart+nLen, m_vArena.size()*2));
+			return &m_vArena[nStart];
+		}
+
+	public:
+		RecordBatch()
+			: m_nArenaLen(0)
+			, m_nFirstRecord(0)
+		{
+		}
+
+		inline void Clear(__int64 nFirstRecord = 0)
+		{
+			m_nArenaLen = 0;
+			m_vOffsets.clear();
+			m_nFirstRecord = nFirstRecord;
+		}
+
+		inline size_t size() const { return m_vOffsets.size(); }
+		inline bool empty() const { return m_vOffsets.empty(); }
+		// the record # of (*this)[0]
+		inline __int64 GetFirstRecord() const { return m_nFirstRecord; }
+
+		inline const RecordData * operator [](size_t n) const { return reinterpret_cast<const RecordData *>(&m_vArena[m_vOffsets[n]]); }
+
+		// the records themselves, and where each one starts in it
+		inline const char * GetArena() const { return m_vArena.empty() ? NULL : &m_vArena[0]; }
+		inline size_t GetArenaLen() const { return m_nArenaLen; }
+		inline const std::vector<size_t> & GetOffsets() const { return m_vOffsets; }
+
+		// appends a copy of a record that is already in memory
+		void Add(const RecordInfo &recordInfo, const RecordData *pRec)
+		{
+			size_t nStart = (m_nArenaLen + Alignment-1) & ~(Alignment-1);
+			size_t nLen = recordInfo.GetRecordLen(pRec);
+			memcpy(Grow(nStart, nLen), pRec, nLen);
+			m_vOffsets.push_back(nStart);
+			m_nArenaLen = nStart + nLen;
+		}
+
+		// appends the next record from file - the same as RecordInfo::Read, but into the arena.
+		// false (and nothing is added) if the file ends partway through the record
+		bool Read(const RecordInfo &recordInfo, LZFBufferedInput<FileBase *> &file);
+		bool Read(const RecordInfo &recordInfo, BufferedInput<FileBase *> &file);
+
+	private:
+		template <class TFile> bool ReadFrom(const RecordInfo &recordInfo, TFile &file);
+	};
+
+	///////////////////////////////////////////////////////////////////////////////
+	// ColumnBatch
+	// a RecordBatch turned around into a column per field, laid out the way Arrow lays out its arrays.
+	// The values are decoded straight out of the record layout, without going through the FieldBase
+	// virtuals one value at a time, so vectorized code can use the columns as they are
+	class ColumnBatch
+	{
+	public:
+		enum E_ColumnType
+		{
+			CT_Bool,		// vBits
+			CT_Int64,		// Byte, Int16, Int32 and Int64 - vInt64
+			CT_Double,		// Float and Double - vDouble
+			CT_String,		// String, V_String, Date, Time, DateTime and FixedDecimal - the chars as they are stored
+			CT_WString,		// WString and V_WString - wchar_t's as they are stored
+			CT_Binary,		// Blob and SpatialObj
+		};
+
+		struct Column
+		{
+			E_ColumnType type;
+			unsigned nField;
+
+			// bit n (least significant bit first) is set if value n isn't NULL.  NULL values are 0 or empty
+			std::vector<unsigned char> vValidity;
+			size_t nNullCount;
+
+			std::vector<__int64> vInt64;
+			std::vector<double> vDouble;
+			// CT_Bool: 1 bit per value, the same as vValidity
+			std::vector<unsigned char> vBits;
+			// CT_String, CT_WString and CT_Binary: value n is the bytes of vData from vOffsets[n] up to vOffsets[n+1]
+			std::vector<__int64> vOffsets;
+			std::vector<char> vData;
+
+			Column() : type(CT_Int64), nField(0), nNullCount(0) {}
+		};
+
+	private:
+		std::vector<Column> m_vColumns;
+		size_t m_nNumRows;
+		__int64 m_nFirstRecord;
+
+	public:
+		ColumnBatch()
+			: m_nNumRows(0)
+			, m_nFirstRecord(0)
+		{
+		}
+
+		// replaces what was here with the records of batch, which are laid out by recordInfo.
+		// The memory from the last Decode is reused
+		void Decode(const RecordInfo &recordInfo, const RecordBatch &batch);
+
+		inline size_t size() const { return m_nNumRows; }
+		inline bool empty() const { return m_nNumRows==0; }
+		// the record # of the first row
+		inline __int64 GetFirstRecord() const { return m_nFirstRecord; }
+
+		inline size_t NumColumns() const { return m_vColumns.size(); }
+		inline const Column & operator [](size_t n) const { return m_vColumns[n]; }
+
+		inline static bool GetBit(const std::vector<unsigned char> &vBitmap, size_t n) { return ((vBitmap[n>>3]>>(n&7)) & 1)!=0; }
+	};
+
 	///////////////////////////////////////////////////////////////////////////////
 	// Open_AlteryxYXDB
 	class Open_AlteryxYXDB
 	{
-		std::unique_ptr<File_Large> m_pFile;
+	public:
+		enum E_FileAccess
+		{
+			FA_Default,			// File_Large - read() each compressed block into a buffer
+			FA_MemoryMapped,	// File_MemoryMapped - decompress straight out of the mapped file
+			FA_ReadAhead,		// File_ReadAhead - read the next compressed blocks while decompressing the current one
+			FA_Stream,			// File_Stream - a pipe or stdin (/dev/stdin).  Records can only be read in order, GoRecord can only go forward
+			FA_Memory,			// File_Memory - see OpenFromMemory
+		};
+
+	private:
+		// when reading, this is a File_Cursor into m_pSharedFile
+		std::unique_ptr<FileBase> m_pFile;
+		std::shared_ptr<FileBase> m_pSharedFile;
+		E_FileAccess m_fileAccess;
+		bool m_bDirectIO;
+		__int64 m_nExpectedSize;
+		bool m_bStreamOutput;
+		unsigned m_nCompressionThreads;
+		unsigned m_nDecompressionThreads;
+		BlockCodec m_codec;
+		bool m_bSkipIncompressible;
+		unsigned m_nBlockSize;
+		std::shared_ptr<LZFBufferPool> m_pBufferPool;
+		bool m_bChecksums;
+		bool m_bVerifyChecksums;
+		bool m_bBlockDirectory;
+		bool m_bZeroCopy;
+
+		// the records can only be read in order: reading from a stream, a streamed file without its trailer,
+		// or a file with no record block index
+		bool m_bForwardOnly;
+
+		// reading starts out hinted as sequential, and switches to random after enough GoRecord jumps
+		// unless the caller has set the hint themselves
+		FileBase::E_AccessHint m_accessHint;
+		bool m_bAccessHintSet;
+		unsigned m_nBlockJumps;
 
 	public:
 		RecordInfo m_recordInfo;
 	private:
 		SmartPointerRefObj<Record> m_pRecord;
 
+		// see SetProjection.  m_fileRecordInfo is the whole record as it is in the file,
+		// and m_pProjection copies the projected fields out of it into m_pRecord
+		std::vector<WStringNoCase> m_vProjectedFields;
+		RecordInfo m_fileRecordInfo;
+		SmartPointerRefObj<RecordCopier> m_pProjection;
+		SmartPointerRefObj<Record> m_pFileRecord;
+		bool m_bProjectVarData;
+		std::vector<char> m_vProjectionBuffer;
+
+		// ReadColumns reads the records into this first
+		RecordBatch m_columnRecords;
+
 		bool m_bIndexStartsBlock;
 
 		void GoBlockRecord(__int64 nRecord);
-
-		SmartPointerRefObj<LZFBufferedInput<File_Large * > > m_pCompressInput;
-		SmartPointerRefObj<LZFBufferedOutput<File_Large *, GenericEngineBase> > m_pCompressOutput;
+		bool NextRecord();
+		const RecordData * GetRecordInPlace(const RecordInfo &recordInfo);
+		void InitProjection();
+		const RecordData * ReadProjectedRecord();
+		void InitRead();
+		void InitCreate(const wchar_t *pRecordInfoXml);
+		void LoadRecordBlockIndex();
+		void LoadBlockDirectory();
+		const LZFBlockEntry * FindBlockEntry(__int64 nRecord);
+		void ReadStreamTrailer();
+		void WillNeedBlock(unsigned nBlock);
+
+		// owned outright like the file, so Close can stop the read ahead threads and give back the buffers
+		std::unique_ptr<LZFBufferedInput<FileBase * > > m_pCompressInput;
+		// for files that aren't compressed
+		std::unique_ptr<BufferedInput<FileBase * > > m_pBufferedInput;
+		// owned outright, so Close can stop its threads before the file goes away
+		std::unique_ptr<LZFBufferedOutput<FileBase *, GenericEngineBase> > m_pCompressOutput;
 
 		Header m_header;
 		bool m_bCreateMode;
@@ -156,30 +750,151 @@ namespace Alteryx  { namespace OpenYXDB
 
 		// the record blocks are always 64K records, except for the last one
 		std::vector<__int64> m_vRecordBlockIndexPos;
+		// see SetBlockDirectory.  Built up while writing, and loaded on demand when reading
+		std::vector<LZFBlockEntry> m_vBlockDirectory;
+		bool m_bBlockDirectoryLoaded;
 
 
 	public:
 
 		Open_AlteryxYXDB()
-			: m_bIndexStartsBlock(false)
+			: m_fileAccess(FA_Default)
+			, m_bDirectIO(false)
+			, m_nExpectedSize(0)
+			, m_bStreamOutput(false)
+			, m_nCompressionThreads(0)
+			, m_nDecompressionThreads(0)
+			, m_bSkipIncompressible(false)
+			, m_nBlockSize(LZFDefaultBlockSize)
+			, m_bChecksums(false)
+			, m_bVerifyChecksums(true)
+			, m_bBlockDirectory(false)
+			, m_bZeroCopy(false)
+			, m_bForwardOnly(false)
+			, m_accessHint(FileBase::AH_Sequential)
+			, m_bAccessHintSet(false)
+			, m_nBlockJumps(0)
+			, m_bProjectVarData(false)
+			, m_bIndexStartsBlock(false)
 			, m_bCreateMode(false)
 			, m_nCurrentRecord(0)
+			, m_bBlockDirectoryLoaded(false)
 		{
 
 		}
 		~Open_AlteryxYXDB();
 		void Close();
 
-		void Open(WString strFile);
+		void Open(WString strFile, E_FileAccess fileAccess = FA_Default);
+		// the same as SetProjection(vFields) and then Open
+		void Open(WString strFile, const std::vector<WStringNoCase> &vFields, E_FileAccess fileAccess = FA_Default);
+		// reads a YXDB that is already in memory.  pData isn't copied, so it has to stay valid until Close
+		void OpenFromMemory(const void *pData, size_t nSize);
+
+		// opens another reader on the file that source already has open - without reopening it.
+		// Each reader has its own position, so different threads can each use their own reader
+		// to scan different record blocks of the same file at the same time.
+		// source must stay open while doing this, but can be closed independently afterwards
+		void OpenCursor(const Open_AlteryxYXDB &source);
 		void Create(WString strFile, const wchar_t *pRecordInfoXml);
+		// writes the YXDB into r_vData instead of a file.  It is complete after Close
+		void CreateInMemory(std::vector<unsigned char> &r_vData, const wchar_t *pRecordInfoXml);
+
+		// call before Create.  The file is written with direct I/O so a large export doesn't
+		// push everything else out of the page cache
+		void SetDirectIO(bool bDirectIO = true) { m_bDirectIO = bDirectIO; }
+		// call before Create.  The disk space is reserved up front, which keeps very large files from fragmenting
+		void SetExpectedSize(__int64 nExpectedSize) { m_nExpectedSize = nExpectedSize; }
+		// call before Create.  Writes without ever seeking back, so the output can be a pipe or a socket.
+		// The record count and block index go in a trailer at the end - see FF_StreamTrailer.
+		// This reads it either way, or FinalizeStream will turn it into a regular file
+		void SetStreamOutput(bool bStreamOutput = true) { m_bStreamOutput = bStreamOutput; }
+		// call before Create.  Compresses the record blocks on this many threads while the caller keeps appending.
+		// 0 (the default) compresses in the calling thread
+		void SetCompressionThreads(unsigned nNumThreads) { m_nCompressionThreads = nNumThreads; }
+		// call before Create.  What to compress the record blocks with - LZF at LZF_Default by default.
+		// BC_LZF takes an E_LZFLevel, and any reader can read it at any level.
+		// BC_LZ4 decompresses faster, and with nLevel 1 to LZ4BLOCK_MAX_LEVEL it is also smaller (but slower to write).
+		// Anything other than LZF needs a reader that knows FF_BlockCodec
+		void SetCompression(E_BlockCodec codec, int nLevel = 0) { m_codec = BlockCodec(codec, nLevel); }
+		// call before Create.  For files with a lot of already compressed blobs (images, etc...) - blocks that look
+		// like they won't compress are written uncompressed without spending the time trying.
+		// See LZFBufferedOutput::SetSkipIncompressible
+		void SetSkipIncompressible(bool bSkip = true) { m_bSkipIncompressible = bSkip; }
+		// call before Create.  How much data goes in each compressed block, from LZFMinBlockSize to LZFMaxBlockSize.
+		// Smaller blocks are quicker to get one record out of, bigger ones compress better and scan faster.
+		// Anything but LZFDefaultBlockSize needs a reader that knows FF_BlockSize
+		void SetBlockSize(unsigned nBlockSize) { m_nBlockSize = LZFCheckBlockSize(nBlockSize); }
+		// call before Create or Open.  The block buffers come from pPool and go back to it at Close,
+		// instead of being allocated for every file.  One pool can be shared by any number of files
+		void SetBufferPool(std::shared_ptr<LZFBufferPool> pPool) { m_pBufferPool = pPool; }
+		// call before Create.  Each compressed block gets a CRC32C, so corruption is caught instead of decoding
+		// into garbage.  It costs next to nothing with SSE4.2 or ARMv8 CRC.  Needs a reader that knows FF_BlockChecksum
+		void SetChecksums(bool bChecksums = true) { m_bChecksums = bChecksums; }
+		// call before Open.  By default the checksums (if the file has them) are checked on each block as it is read.
+		// This turns that off - VerifyChecksums can still check the whole file
+		void SetVerifyChecksums(bool bVerify) { m_bVerifyChecksums = bVerify; }
+		// checks every block of a file written with SetChecksums, without decompressing any of them.
+		// Throws if one is bad.  Returns false if the file doesn't have checksums
+		static bool VerifyChecksums(WString strFile, E_FileAccess fileAccess = FA_Default);
+		// call before Create.  Writes a directory of every compressed block after the record block index, so any
+		// block can be found and decompressed on its own - see GetBlockDirectory.  GoRecord also uses it to start
+		// at the block the record is in, instead of reading through its whole 64K record block.  A smaller
+		// SetBlockSize makes that faster still.  Needs a reader that knows FF_BlockDirectory
+		void SetBlockDirectory(bool bBlockDirectory = true) { m_bBlockDirectory = bBlockDirectory; }
+		// the directory written by SetBlockDirectory, in file order.  Empty if the file doesn't have one
+		const std::vector<LZFBlockEntry> & GetBlockDirectory();
+		// decompresses block nBlock of GetBlockDirectory into r_vData.  It doesn't change which record is read next,
+		// and doesn't touch anything ReadRecord does, so other threads can use it on the same file at the same time
+		void ReadBlock(size_t nBlock, std::vector<unsigned char> &r_vData);
+		// moves the trailer of a file written with SetStreamOutput into its header, so any reader can read it
+		static void FinalizeStream(WString strFile);
+
+		// call before Open.  Reads ahead and decompresses the next few compressed blocks on this many threads,
+		// which speeds up scanning through the records.  0 (the default) decompresses in the calling thread
+		void SetDecompressionThreads(unsigned nNumThreads) { m_nDecompressionThreads = nNumThreads; }
+		// ReadRecord returns a pointer straight into the decompressed block instead of copying the record out,
+		// unless the record crosses into the next block.  The record is only good until the next call on this
+		// reader (GoRecord included), and isn't necessarily aligned.  Only compressed files can do this
+		void SetZeroCopy(bool bZeroCopy = true) { m_bZeroCopy = bZeroCopy; }
+		// call before Open.  Only reads the fields in vFields, in that order - m_recordInfo and the records
+		// have just those fields.  The rest are never copied anywhere, and if none of vFields are var data
+		// (strings, blobs, spatial objects) the var data is skipped over without being looked at.
+		// Throws from Open if a field isn't in the file.  An empty vFields reads the whole record
+		void SetProjection(const std::vector<WStringNoCase> &vFields) { m_vProjectedFields = vFields; }
+
+		// how the records are going to be read.  By default this is worked out from the calls to GoRecord.
+		// Set before Open, the OS is told too, which goes for every cursor opened on the file.
+		// Otherwise it only changes how far ahead this reader asks for
+		void SetAccessHint(FileBase::E_AccessHint hint);
 
 		const RecordData * ReadRecord();
+		// reads up to nMaxRecords of the next records into r_batch (replacing what was in it), in one go.
+		// Returns how many it read - 0 at the end of the file.  Cheaper per record than ReadRecord,
+		// and the records stay good until the next ReadRecords into the same batch
+		size_t ReadRecords(RecordBatch &r_batch, size_t nMaxRecords);
+		// the same as ReadRecords, but decoded into a column per field - see ColumnBatch.
+		// The columns follow m_recordInfo, so with SetProjection there is just a column for each projected field
+		size_t ReadColumns(ColumnBatch &r_columns, size_t nMaxRecords = RecordsPerBlock);
 		void AppendRecord(const RecordData *pRec);
 
+		// -1 if it isn't known yet (reading a stream that was written as a stream)
 		__int64 GetNumRecords();
 
 		void GoRecord(__int64 nRecord = 0);
 
+		// called by ParallelScan for every record, on one of its threads.  recordInfo belongs to that thread,
+		// and pRec is only good until the callback returns
+		typedef std::function<void (unsigned nThread, const RecordInfo &recordInfo, __int64 nRecord, const RecordData *pRec)> ScanCallback;
+		// reads every record on nNumThreads threads (0 for 1 per core), each with its own cursor (see OpenCursor).
+		// The 64K record blocks are handed out in order as the threads finish their last one, so the records within
+		// a block come in order but the blocks don't.  The first exception on any thread stops the scan and is
+		// thrown from here.  This reader's own position doesn't change, except when the file can't be split up:
+		// a stream (which can only have the 1 reader), anything else that can only be read forward, or a file of
+		// just 1 block.  Then this reader scans it by itself from the first record (which a stream can't go back to
+		// once it has been read from), and is left at the end
+		void ParallelScan(unsigned nNumThreads, const ScanCallback &callback);
+
 		WString GetRecordXmlMetaData();
 	};
 } }
@@ -364,6 +364,9 @@ namespace SRC
 		const GenericEngineBase * GetGenericEngine() const { return m_pGenericEngineBase; }
 
 		inline unsigned NumFields() const { return unsigned(m_vFields.size()); }
+		// the fixed part of the record - followed by an int of the var data length and the var data if ContainsVarData
+		inline unsigned GetFixedRecordSize() const { return unsigned(m_nFixedRecordSize); }
+		inline bool ContainsVarData() const { return m_bContainsVarData; }
 		inline const FieldBase * operator [](size_t n) const { return m_vFields[n].Get(); }
 		inline void ResetForLateRename(unsigned maxlen, bool bStrictNaming) 
 		{ 
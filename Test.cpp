@@ -1,8 +1,12 @@
 
 #include "stdafx.h"
 #include "Open_AlteryxYXDB.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <random>
+#include <thread>
 
 // only used for generating sample data
 SRC::AString EnglishNumber(int n);
@@ -102,6 +106,1591 @@ void ReadSampleFile(const wchar_t *pFile)
 		std::cout << "\n";
 	}
 }
+///////////////////////////////////////////////////////////////////////////////
+// checks on the file format.  Each one throws an Error if something is wrong
+
+void Check(bool bOk, const wchar_t *pWhat)
+{
+	if (!bOk)
+		throw SRC::Error(SRC::WString(L"Test failed: ") + pWhat);
+}
+
+// true if f throws an Error - anything else (or a crash) is still a failure
+template <class F> bool Throws(F f)
+{
+	try
+	{
+		f();
+	}
+	catch (SRC::Error)
+	{
+		return true;
+	}
+	return false;
+}
+
+typedef Alteryx::OpenYXDB::Open_AlteryxYXDB YXDB;
+
+// the file format tests write a few 64K record blocks, so there are block boundaries to get across
+const unsigned NumTestRecords = 150000;
+
+// test record n is n, a random number and that number in English
+struct TestValues
+{
+	std::vector<int> vNumbers;
+	std::vector<SRC::AString> vEnglish;
+
+	TestValues()
+	{
+		std::mt19937 r;
+		for (unsigned x = 0; x<NumTestRecords; ++x)
+		{
+			int v = r();
+			vNumbers.push_back(v);
+			vEnglish.push_back(EnglishNumber(v));
+		}
+	}
+};
+
+const TestValues & GetTestValues()
+{
+	static const TestValues values;
+	return values;
+}
+
+SRC::WString TestRecordXml()
+{
+	SRC::RecordInfo recordInfo;
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"Index", SRC::E_FT_Int64));
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"Number", SRC::E_FT_Double));
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"English", SRC::E_FT_V_String, 256));
+	return recordInfo.GetRecordXmlMetaData();
+}
+
+// appends the test records to a file that was just created with TestRecordXml
+void AppendTestRecords(YXDB &fileOut, unsigned nNumRecords = NumTestRecords)
+{
+	const TestValues &values = GetTestValues();
+	SRC::SmartPointerRefObj<SRC::Record> pRec = fileOut.m_recordInfo.CreateRecord();
+	for (unsigned x = 0; x<nNumRecords; ++x)
+	{
+		pRec->Reset();
+		fileOut.m_recordInfo[0]->SetFromInt64(pRec.Get(), x);
+		fileOut.m_recordInfo[1]->SetFromInt32(pRec.Get(), values.vNumbers[x]);
+		fileOut.m_recordInfo[2]->SetFromString(pRec.Get(), values.vEnglish[x]);
+		fileOut.AppendRecord(pRec->GetRecord());
+	}
+}
+
+// checks pRec is test record nRecord.  recordInfo can have any of the test fields, in any order
+void CheckTestRecord(const SRC::RecordInfo &recordInfo, const SRC::RecordData *pRec, __int64 nRecord)
+{
+	const TestValues &values = GetTestValues();
+	Check(pRec!=NULL, L"a record is missing");
+	Check(nRecord>=0 && nRecord<__int64(NumTestRecords), L"there are too many records");
+	for (unsigned x = 0; x<recordInfo.NumFields(); ++x)
+	{
+		const SRC::FieldBase *pField = recordInfo[x];
+		if (wcscmp(pField->GetFieldName().c_str(), L"Index")==0)
+			Check(pField->GetAsInt64(pRec).value==nRecord, L"a record is out of place");
+		else if (wcscmp(pField->GetFieldName().c_str(), L"Number")==0)
+			Check(pField->GetAsDouble(pRec).value==double(values.vNumbers[size_t(nRecord)]), L"the Number field doesn't match");
+		else
+			Check(values.vEnglish[size_t(nRecord)]==pField->GetAsAString(pRec).value.pValue, L"the English field doesn't match");
+	}
+}
+
+// reads the rest of the records with ReadRecord, checking each one.  Returns the # of the record after the last
+__int64 CheckTestRecords(YXDB &file, __int64 nFirstRecord = 0)
+{
+	__int64 nRecord = nFirstRecord;
+	while (const SRC::RecordData *pRec = file.ReadRecord())
+		CheckTestRecord(file.m_recordInfo, pRec, nRecord++);
+	return nRecord;
+}
+
+// reads the rest of file in batches of nBatchSize, checking each record.  Returns the # of the record after the last
+__int64 CheckTestBatches(YXDB &file, size_t nBatchSize, __int64 nFirstRecord = 0)
+{
+	Alteryx::OpenYXDB::RecordBatch batch;
+	__int64 nRecord = nFirstRecord;
+	while (file.ReadRecords(batch, nBatchSize)!=0)
+	{
+		Check(batch.GetFirstRecord()==nRecord && batch.size()<=nBatchSize, L"a batch is out of place");
+		for (size_t x = 0; x<batch.size(); ++x)
+			CheckTestRecord(file.m_recordInfo, batch[x], nRecord++);
+	}
+	return nRecord;
+}
+
+// writes the test records to pFile with the plain File_Large writer.  setup can call the setters before Create
+void WriteTestFile(const wchar_t *pFile, unsigned nNumRecords = NumTestRecords, const std::function<void (YXDB &)> &setup = std::function<void (YXDB &)>())
+{
+	YXDB fileOut;
+	if (setup)
+		setup(fileOut);
+	fileOut.Create(pFile, TestRecordXml());
+	AppendTestRecords(fileOut, nNumRecords);
+	fileOut.Close();
+}
+
+// the same as WriteTestFile, into memory
+std::vector<unsigned char> WriteTestMemory(unsigned nNumRecords = NumTestRecords, const std::function<void (YXDB &)> &setup = std::function<void (YXDB &)>())
+{
+	std::vector<unsigned char> vData;
+	YXDB fileOut;
+	if (setup)
+		setup(fileOut);
+	fileOut.CreateInMemory(vData, TestRecordXml());
+	AppendTestRecords(fileOut, nNumRecords);
+	fileOut.Close();
+	return vData;
+}
+
+// reads the rest of file alongside a plain File_Large read of pFile, and checks every record is the same bytes
+void CheckSameAsPlain(YXDB &file, const wchar_t *pFile)
+{
+	YXDB plain;
+	plain.Open(pFile);
+	for (;;)
+	{
+		const SRC::RecordData *pRec = file.ReadRecord();
+		const SRC::RecordData *pPlain = plain.ReadRecord();
+		Check((pRec==NULL)==(pPlain==NULL), L"a different number of records than a plain read");
+		if (pRec==NULL)
+			break;
+		size_t nLen = plain.m_recordInfo.GetRecordLen(pPlain);
+		Check(file.m_recordInfo.GetRecordLen(pRec)==nLen && memcmp(pRec, pPlain, nLen)==0, L"a record is different to a plain read");
+	}
+}
+
+// where the length of the first compressed block is
+size_t FirstBlockPos(const std::vector<unsigned char> &vData)
+{
+	const Alteryx::OpenYXDB::Header *pHeader = reinterpret_cast<const Alteryx::OpenYXDB::Header *>(&vData[0]);
+	return sizeof(Alteryx::OpenYXDB::Header) + pHeader->userHdr.nMetaInfoLen*sizeof(wchar_t);
+}
+
+// random bytes, or text that repeats itself a lot the way record data does
+std::vector<unsigned char> TestBuffer(size_t nSize, bool bCompressible, unsigned nSeed)
+{
+	std::mt19937 r(nSeed);
+	std::vector<unsigned char> vData;
+	while (vData.size()<nSize)
+	{
+		if (bCompressible)
+		{
+			SRC::AString strNumber = EnglishNumber(int(r() % 100000));
+			vData.insert(vData.end(), strNumber.c_str(), strNumber.c_str()+strNumber.length());
+			vData.push_back(',');
+		}
+		else
+			vData.push_back((unsigned char)r());
+	}
+	vData.resize(nSize);
+	return vData;
+}
+
+// Close has to write the record block index, or nothing past the first 64K records can be found
+void TestRecordBlockIndex()
+{
+	WriteTestFile(L"test_index.yxdb");
+
+	YXDB file;
+	file.Open(L"test_index.yxdb");
+	Check(file.GetNumRecords()==NumTestRecords, L"the wrong record count");
+	Check(CheckTestRecords(file)==NumTestRecords, L"the wrong number of records");
+
+	// into each record block, on either side of the boundaries, and back again
+	const __int64 records[] = { 140000, 65536, 65535, 0, 131072, 131071, NumTestRecords-1, 70000, 5 };
+	for (unsigned x = 0; x<sizeof(records)/sizeof(*records); ++x)
+	{
+		file.GoRecord(records[x]);
+		CheckTestRecord(file.m_recordInfo, file.ReadRecord(), records[x]);
+	}
+
+	// a cursor shares the file, but not the position
+	YXDB cursor;
+	cursor.OpenCursor(file);
+	cursor.GoRecord(100000);
+	file.GoRecord(3);
+	Check(CheckTestRecords(cursor, 100000)==NumTestRecords, L"a cursor didn't read to the end");
+	CheckTestRecord(file.m_recordInfo, file.ReadRecord(), 3);
+}
+
+// a mapped file is decompressed straight out of the mapping, so it has to read the same as a plain read of it.
+// With small blocks, GoRecord and a cursor move around it a lot
+void TestMemoryMapped()
+{
+	WriteTestFile(L"test_plain.yxdb");
+	WriteTestFile(L"test_mapped.yxdb", NumTestRecords, [](YXDB &fileOut) { fileOut.SetBlockSize(0x4000); });
+	const wchar_t *files[] = { L"test_plain.yxdb", L"test_mapped.yxdb" };
+	for (unsigned x = 0; x<sizeof(files)/sizeof(*files); ++x)
+	{
+		YXDB file;
+		file.Open(files[x], YXDB::FA_MemoryMapped);
+		Check(file.GetNumRecords()==NumTestRecords, L"the wrong record count from a mapped file");
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+
+		const __int64 records[] = { 140000, 65535, 65536, 3, NumTestRecords-1 };
+		for (unsigned n = 0; n<sizeof(records)/sizeof(*records); ++n)
+		{
+			file.GoRecord(records[n]);
+			CheckTestRecord(file.m_recordInfo, file.ReadRecord(), records[n]);
+		}
+
+		YXDB cursor;
+		cursor.OpenCursor(file);
+		cursor.GoRecord(70000);
+		Check(CheckTestRecords(cursor, 70000)==NumTestRecords, L"a cursor on a mapped file didn't read to the end");
+	}
+}
+
+// the read ahead has to hand back the same bytes as reading the file directly, with io_uring and with the thread.
+// Small chunks and odd sized reads put plenty of reads across the chunk edges
+void TestReadAhead()
+{
+	WriteTestFile(L"test_plain.yxdb");
+
+	std::shared_ptr<Alteryx::OpenYXDB::File_Large> pPlain(new Alteryx::OpenYXDB::File_Large);
+	pPlain->OpenForRead(L"test_plain.yxdb");
+	std::vector<unsigned char> vPlain(size_t(pPlain->GetSize()));
+	Check(pPlain->Read(&vPlain[0], unsigned(vPlain.size()))==vPlain.size(), L"the plain file didn't read");
+
+	for (unsigned nEngine = 0; nEngine<2; ++nEngine)
+	{
+		Alteryx::OpenYXDB::File_ReadAhead file(pPlain, 3, 0x10000, nEngine==0);
+		std::vector<unsigned char> vRead(vPlain.size());
+		size_t nPos = 0;
+		for (unsigned nSize = 1; nPos<vRead.size(); nSize = nSize*7 % 100003)
+		{
+			unsigned nRead = file.Read(&vRead[nPos], unsigned(std::min(vRead.size()-nPos, size_t(nSize))));
+			Check(nRead!=0, L"the read ahead stopped before the end of the file");
+			nPos += nRead;
+		}
+		Check(vRead==vPlain, L"the read ahead read something different to a plain read");
+
+		// and from somewhere else, the way GoRecord moves it
+		file.LSeek(__int64(vPlain.size()/3));
+		unsigned char buffer[5000];
+		Check(file.Read(buffer, sizeof(buffer))==sizeof(buffer) && memcmp(buffer, &vPlain[vPlain.size()/3], sizeof(buffer))==0, L"the read ahead read the wrong thing after an LSeek");
+	}
+
+	YXDB file;
+	file.Open(L"test_plain.yxdb", YXDB::FA_ReadAhead);
+	file.GoRecord(100000);
+	Check(CheckTestRecords(file, 100000)==NumTestRecords, L"FA_ReadAhead didn't read to the end after a GoRecord");
+	file.GoRecord(0);
+	CheckSameAsPlain(file, L"test_plain.yxdb");
+}
+
+// each block goes out as its length (and checksum) and data in one write.  Following the lengths from the first
+// block has to land exactly on the record block index, however the blocks were compressed
+void TestBlockWrites()
+{
+	WriteTestFile(L"test_plain.yxdb");
+	for (unsigned x = 0; x<4; ++x)
+	{
+		bool bChecksums = (x & 1)!=0;
+		unsigned nThreads = (x & 2)!=0 ? 2 : 0;
+		std::vector<unsigned char> vData = WriteTestMemory(NumTestRecords, [&](YXDB &fileOut)
+		{
+			fileOut.SetBlockSize(0x4000);
+			fileOut.SetChecksums(bChecksums);
+			fileOut.SetCompressionThreads(nThreads);
+		});
+
+		const Alteryx::OpenYXDB::Header *pHeader = reinterpret_cast<const Alteryx::OpenYXDB::Header *>(&vData[0]);
+		size_t nPos = FirstBlockPos(vData);
+		unsigned nNumBlocks = 0;
+		while (__int64(nPos)<pHeader->userHdr.nRecordBlockIndexPos)
+		{
+			unsigned nBlockLen;
+			memcpy(&nBlockLen, &vData[nPos], sizeof(nBlockLen));
+			nPos += sizeof(nBlockLen) + (bChecksums ? sizeof(unsigned) : 0) + (nBlockLen & ~0x80000000u);
+			nNumBlocks++;
+		}
+		Check(__int64(nPos)==pHeader->userHdr.nRecordBlockIndexPos && nNumBlocks>100, L"the blocks don't follow one another up to the record block index");
+
+		YXDB file;
+		file.OpenFromMemory(&vData[0], vData.size());
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+	}
+}
+
+// the size of the file on disk
+__int64 TestFileSize(const wchar_t *pFile)
+{
+	Alteryx::OpenYXDB::File_Large file;
+	file.OpenForRead(pFile);
+	return file.GetSize();
+}
+
+// preallocating more than the file needs mustn't leave it any bigger, and less mustn't stop it growing.
+// The access hints only change what the OS is told, so the records read the same either way
+void TestPreallocateAndHints()
+{
+	WriteTestFile(L"test_plain.yxdb");
+	const __int64 expectedSizes[] = { 0x4000000, 0x100000 };
+	for (unsigned x = 0; x<sizeof(expectedSizes)/sizeof(*expectedSizes); ++x)
+	{
+		WriteTestFile(L"test_prealloc.yxdb", NumTestRecords, [&](YXDB &fileOut) { fileOut.SetExpectedSize(expectedSizes[x]); });
+		Check(TestFileSize(L"test_prealloc.yxdb")==TestFileSize(L"test_plain.yxdb"), L"a preallocated file isn't the size of a plain one");
+
+		YXDB file;
+		file.Open(L"test_prealloc.yxdb");
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+	}
+
+	const Alteryx::OpenYXDB::FileBase::E_AccessHint hints[] = { Alteryx::OpenYXDB::FileBase::AH_Sequential, Alteryx::OpenYXDB::FileBase::AH_Random };
+	for (unsigned x = 0; x<sizeof(hints)/sizeof(*hints); ++x)
+	{
+		YXDB file;
+		file.SetAccessHint(hints[x]);
+		file.Open(L"test_prealloc.yxdb");
+		const __int64 records[] = { 131072, 65535, 149999, 1 };
+		for (unsigned n = 0; n<sizeof(records)/sizeof(*records); ++n)
+		{
+			file.GoRecord(records[n]);
+			CheckTestRecord(file.m_recordInfo, file.ReadRecord(), records[n]);
+		}
+		file.GoRecord(0);
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+	}
+}
+
+// writes vData to pFile as it is
+void WriteBytes(const wchar_t *pFile, const std::vector<unsigned char> &vData)
+{
+	Alteryx::OpenYXDB::File_Large file;
+	file.OpenForWrite(pFile);
+	file.Write(&vData[0], unsigned(vData.size()));
+	file.Close();
+}
+
+// nothing writes the old uncompressed format (nCompressionVersion 0) any more, so this makes one out of a
+// compressed file: the blocks decompressed one after the other are the records, and the record block index
+// points at the blocks that start each 64K records
+std::vector<unsigned char> UncompressedTestMemory()
+{
+	std::vector<unsigned char> vCompressed = WriteTestMemory();
+	Alteryx::OpenYXDB::Header header = *reinterpret_cast<const Alteryx::OpenYXDB::Header *>(&vCompressed[0]);
+	size_t nIndexPos = size_t(header.userHdr.nRecordBlockIndexPos);
+	unsigned nNumIndex;
+	memcpy(&nNumIndex, &vCompressed[nIndexPos], sizeof(nNumIndex));
+	std::vector<__int64> vIndex(nNumIndex);
+	memcpy(&vIndex[0], &vCompressed[nIndexPos+sizeof(nNumIndex)], nNumIndex*sizeof(__int64));
+
+	size_t nPos = FirstBlockPos(vCompressed);
+	std::vector<unsigned char> vData(vCompressed.begin(), vCompressed.begin()+nPos);
+	std::vector<unsigned char> vBlock(SRC::LZFDefaultBlockSize);
+	while (nPos<nIndexPos)
+	{
+		for (unsigned x = 0; x<nNumIndex; ++x)
+			if (vIndex[x]==__int64(nPos))
+				vIndex[x] = __int64(vData.size());
+
+		unsigned nBlockLen;
+		memcpy(&nBlockLen, &vCompressed[nPos], sizeof(nBlockLen));
+		const unsigned char *pBlock = &vCompressed[nPos+sizeof(nBlockLen)];
+		if (nBlockLen & 0x80000000)
+			vData.insert(vData.end(), pBlock, pBlock + (nBlockLen & ~0x80000000u));
+		else
+		{
+			unsigned nSize = lzf_decompress(pBlock, nBlockLen, &vBlock[0], unsigned(vBlock.size()));
+			Check(nSize!=0, L"a test block didn't decompress");
+			vData.insert(vData.end(), vBlock.begin(), vBlock.begin()+nSize);
+		}
+		nPos += sizeof(nBlockLen) + (nBlockLen & ~0x80000000u);
+	}
+
+	header.userHdr.nCompressionVersion = 0;
+	header.userHdr.nRecordBlockIndexPos = vData.size();
+	memcpy(&vData[0], &header, sizeof(header));
+	vData.insert(vData.end(), reinterpret_cast<const unsigned char *>(&nNumIndex), reinterpret_cast<const unsigned char *>(&nNumIndex+1));
+	vData.insert(vData.end(), reinterpret_cast<const unsigned char *>(&vIndex[0]), reinterpret_cast<const unsigned char *>(&vIndex[0]+nNumIndex));
+	return vData;
+}
+
+// the buffered reader of uncompressed files has to read the same records as a compressed file has, across the
+// 64K record blocks, one at a time and in batches.  Without a record block index it can still read straight through
+void TestUncompressed()
+{
+	WriteTestFile(L"test_plain.yxdb");
+	std::vector<unsigned char> vData = UncompressedTestMemory();
+	WriteBytes(L"test_uncompressed.yxdb", vData);
+
+	YXDB file;
+	file.Open(L"test_uncompressed.yxdb");
+	Check(file.GetNumRecords()==NumTestRecords, L"the wrong record count from an uncompressed file");
+	CheckSameAsPlain(file, L"test_plain.yxdb");
+	const __int64 records[] = { 140000, 65536, 65535, 0, 131071, 7 };
+	for (unsigned x = 0; x<sizeof(records)/sizeof(*records); ++x)
+	{
+		file.GoRecord(records[x]);
+		CheckTestRecord(file.m_recordInfo, file.ReadRecord(), records[x]);
+	}
+	file.GoRecord(0);
+	Check(CheckTestBatches(file, 7000)==NumTestRecords, L"the batches of an uncompressed file didn't read every record");
+
+	YXDB memory;
+	memory.OpenFromMemory(&vData[0], vData.size());
+	CheckSameAsPlain(memory, L"test_plain.yxdb");
+
+	reinterpret_cast<Alteryx::OpenYXDB::Header *>(&vData[0])->userHdr.nRecordBlockIndexPos = 0;
+	YXDB noIndex;
+	noIndex.OpenFromMemory(&vData[0], vData.size());
+	noIndex.GoRecord(70000);
+	Check(CheckTestRecords(noIndex, 70000)==NumTestRecords, L"an uncompressed file without an index didn't read to the end");
+	Check(Throws([&] { noIndex.GoRecord(5); }), L"an uncompressed file without an index went back");
+}
+
+// a stream only ever goes forward.  Reading a file through it has to give the same as a plain read - with skips
+// forward, in batches and on decompression threads - and anything that needs to go back has to throw
+void TestStreamRead()
+{
+	WriteTestFile(L"test_plain.yxdb");
+	WriteTestFile(L"test_stream_in.yxdb", NumTestRecords, [](YXDB &fileOut)
+	{
+		fileOut.SetBlockSize(0x4000);
+		fileOut.SetChecksums();
+	});
+
+	Alteryx::OpenYXDB::File_Large plain;
+	plain.OpenForRead(L"test_stream_in.yxdb");
+	std::vector<unsigned char> vPlain(size_t(plain.GetSize()));
+	plain.Read(&vPlain[0], unsigned(vPlain.size()));
+	{
+		Alteryx::OpenYXDB::File_Stream stream;
+		stream.OpenForRead(L"test_stream_in.yxdb");
+		std::vector<unsigned char> vRead(10000);
+		Check(stream.Read(&vRead[0], 5000)==5000, L"a stream read came up short");
+		stream.LSeek(8000);
+		Check(stream.Read(&vRead[8000], 2000)==2000 && std::equal(vRead.begin(), vRead.begin()+5000, vPlain.begin())
+			&& std::equal(vRead.begin()+8000, vRead.end(), vPlain.begin()+8000), L"a stream read something different to a plain read");
+		Check(Throws([&] { stream.LSeek(100); }), L"a stream went back");
+	}
+
+	for (unsigned nThreads = 0; nThreads<=2; nThreads += 2)
+	{
+		YXDB file;
+		file.SetDecompressionThreads(nThreads);
+		file.Open(L"test_stream_in.yxdb", YXDB::FA_Stream);
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+	}
+
+	YXDB file;
+	file.Open(L"test_stream_in.yxdb", YXDB::FA_Stream);
+	file.GoRecord(70000);
+	CheckTestRecord(file.m_recordInfo, file.ReadRecord(), 70000);
+	Check(Throws([&] { file.GoRecord(100); }), L"a stream went back to an earlier record");
+	Check(CheckTestBatches(file, 7000, 70001)==NumTestRecords, L"the batches from a stream didn't read every record");
+}
+
+// the header at the start of pFile, or with bTrailer, the one at the end
+Alteryx::OpenYXDB::Header ReadTestHeader(const wchar_t *pFile, bool bTrailer = false)
+{
+	Alteryx::OpenYXDB::File_Large file;
+	file.OpenForRead(pFile);
+	Alteryx::OpenYXDB::Header header;
+	file.ReadAt(bTrailer ? file.GetSize()-sizeof(header) : 0, &header, sizeof(header));
+	return header;
+}
+
+// a file written as a stream has to read the same as a plain one: as a stream up to its end marker, with the
+// counts from its trailer, and once FinalizeStream has made it a regular file
+void TestStreamWrite()
+{
+	WriteTestFile(L"test_plain.yxdb");
+	for (unsigned nThreads = 0; nThreads<=2; nThreads += 2)
+	{
+		WriteTestFile(L"test_stream_out.yxdb", NumTestRecords, [&](YXDB &fileOut)
+		{
+			fileOut.SetStreamOutput();
+			fileOut.SetBlockSize(0x4000);
+			fileOut.SetBlockDirectory();
+			fileOut.SetCompressionThreads(nThreads);
+		});
+
+		Alteryx::OpenYXDB::Header header = ReadTestHeader(L"test_stream_out.yxdb");
+		Alteryx::OpenYXDB::Header trailer = ReadTestHeader(L"test_stream_out.yxdb", true);
+		Check(header.userHdr.nNumRecords<0 && trailer.userHdr.nNumRecords==NumTestRecords, L"the counts aren't in the stream trailer");
+		{
+			Alteryx::OpenYXDB::File_Large file;
+			file.OpenForRead(L"test_stream_out.yxdb");
+			unsigned nEndMarker = 1;
+			file.ReadAt(trailer.userHdr.nRecordBlockIndexPos-sizeof(nEndMarker), &nEndMarker, sizeof(nEndMarker));
+			Check(nEndMarker==0, L"the blocks of a stream don't end with the end marker");
+		}
+
+		YXDB stream;
+		stream.Open(L"test_stream_out.yxdb", YXDB::FA_Stream);
+		CheckSameAsPlain(stream, L"test_plain.yxdb");
+
+		YXDB file;
+		file.Open(L"test_stream_out.yxdb");
+		Check(file.GetNumRecords()==NumTestRecords, L"the record count wasn't read from the stream trailer");
+		file.GoRecord(140000);
+		CheckTestRecord(file.m_recordInfo, file.ReadRecord(), 140000);
+		file.GoRecord(0);
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+		file.Close();
+
+		YXDB::FinalizeStream(L"test_stream_out.yxdb");
+		header = ReadTestHeader(L"test_stream_out.yxdb");
+		Check(header.userHdr.nNumRecords==NumTestRecords && (header.userHdr.nFormatFlags & Alteryx::OpenYXDB::FF_StreamTrailer)==0, L"FinalizeStream didn't make a regular header");
+		YXDB finalized;
+		finalized.Open(L"test_stream_out.yxdb");
+		finalized.GoRecord(70000);
+		CheckTestRecord(finalized.m_recordInfo, finalized.ReadRecord(), 70000);
+		finalized.GoRecord(0);
+		CheckSameAsPlain(finalized, L"test_plain.yxdb");
+	}
+
+	// a stream that was cut off before its trailer can't be finalized
+	WriteTestFile(L"test_stream_out.yxdb", 1000, [](YXDB &fileOut) { fileOut.SetStreamOutput(); });
+	Alteryx::OpenYXDB::File_Large file;
+	file.OpenForRead(L"test_stream_out.yxdb");
+	std::vector<unsigned char> vData(size_t(file.GetSize()) - 100);
+	file.Read(&vData[0], unsigned(vData.size()));
+	file.Close();
+	WriteBytes(L"test_stream_cut.yxdb", vData);
+	Check(Throws([] { YXDB::FinalizeStream(L"test_stream_cut.yxdb"); }), L"a stream without its trailer was finalized");
+}
+
+// the whole of pFile
+std::vector<unsigned char> ReadBytes(const wchar_t *pFile)
+{
+	Alteryx::OpenYXDB::File_Large file;
+	file.OpenForRead(pFile);
+	std::vector<unsigned char> vData(size_t(file.GetSize()));
+	Check(file.Read(&vData[0], unsigned(vData.size()))==vData.size(), L"a file didn't read");
+	return vData;
+}
+
+// writing to memory has to give the same bytes as writing the file - apart from when it was created - and
+// reading from memory the same records as a plain read, with threads, GoRecord and cursors
+void TestMemoryFiles()
+{
+	WriteTestFile(L"test_plain.yxdb");
+	std::vector<unsigned char> vPlain = ReadBytes(L"test_plain.yxdb");
+	std::vector<unsigned char> vData = WriteTestMemory();
+	Check(vData.size()==vPlain.size(), L"a file written to memory is a different size");
+	memcpy(&vPlain[0], &vData[0], sizeof(Alteryx::OpenYXDB::Header));
+	Check(vData==vPlain, L"a file written to memory is different to the same file on disk");
+
+	for (unsigned nThreads = 0; nThreads<=2; nThreads += 2)
+	{
+		YXDB file;
+		file.SetDecompressionThreads(nThreads);
+		file.OpenFromMemory(&vData[0], vData.size());
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+	}
+
+	YXDB file;
+	file.OpenFromMemory(&vData[0], vData.size());
+	file.GoRecord(131072);
+	CheckTestRecord(file.m_recordInfo, file.ReadRecord(), 131072);
+	YXDB cursor;
+	cursor.OpenCursor(file);
+	cursor.GoRecord(65530);
+	file.GoRecord(10);
+	Check(CheckTestRecords(cursor, 65530)==NumTestRecords, L"a cursor on a memory file didn't read to the end");
+	CheckTestRecord(file.m_recordInfo, file.ReadRecord(), 10);
+}
+
+// records of random bytes (no 0s, so they are still strings), and then of repetitive text
+void WriteMixedFile(const wchar_t *pFile, bool bSkipIncompressible, unsigned nThreads)
+{
+	SRC::RecordInfo recordInfo;
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"Text", SRC::E_FT_V_String, 4000));
+
+	YXDB fileOut;
+	fileOut.SetSkipIncompressible(bSkipIncompressible);
+	fileOut.SetCompressionThreads(nThreads);
+	fileOut.Create(pFile, recordInfo.GetRecordXmlMetaData());
+	SRC::SmartPointerRefObj<SRC::Record> pRec = fileOut.m_recordInfo.CreateRecord();
+	std::mt19937 r;
+	for (unsigned x = 0; x<4000; ++x)
+	{
+		SRC::AString strText;
+		if (x<2000)
+		{
+			for (unsigned n = 0; n<2000; ++n)
+				strText += char(1 + r() % 255);
+		}
+		else
+		{
+			std::vector<unsigned char> vText = TestBuffer(2000, true, x);
+			strText = SRC::AString(reinterpret_cast<const char *>(&vText[0]), vText.size());
+		}
+		pRec->Reset();
+		fileOut.m_recordInfo[0]->SetFromString(pRec.Get(), strText);
+		fileOut.AppendRecord(pRec->GetRecord());
+	}
+	fileOut.Close();
+}
+
+// skipping has to give the same records, write the random blocks uncompressed, and go back to compressing
+// once the data compresses again
+void TestSkipIncompressible()
+{
+	WriteMixedFile(L"test_mixed_plain.yxdb", false, 0);
+	for (unsigned nThreads = 0; nThreads<=2; nThreads += 2)
+	{
+		WriteMixedFile(L"test_mixed.yxdb", true, nThreads);
+		YXDB file;
+		file.Open(L"test_mixed.yxdb");
+		CheckSameAsPlain(file, L"test_mixed_plain.yxdb");
+
+		std::vector<unsigned char> vData = ReadBytes(L"test_mixed.yxdb");
+		const Alteryx::OpenYXDB::Header *pHeader = reinterpret_cast<const Alteryx::OpenYXDB::Header *>(&vData[0]);
+		size_t nPos = FirstBlockPos(vData);
+		unsigned nUncompressed = 0;
+		bool bLastCompressed = false;
+		while (__int64(nPos)<pHeader->userHdr.nRecordBlockIndexPos)
+		{
+			unsigned nBlockLen;
+			memcpy(&nBlockLen, &vData[nPos], sizeof(nBlockLen));
+			bLastCompressed = (nBlockLen & 0x80000000)==0;
+			if (!bLastCompressed)
+				nUncompressed++;
+			nPos += sizeof(nBlockLen) + (nBlockLen & ~0x80000000u);
+		}
+		Check(nUncompressed>=5, L"the random blocks weren't written uncompressed");
+		Check(bLastCompressed, L"the blocks didn't go back to being compressed");
+	}
+}
+
+// every block size has to read back the same, through the threads as well.  Only a size other than the default
+// is recorded in the header, and one out of range is turned down when writing and when reading
+void TestBlockSizes()
+{
+	WriteTestFile(L"test_plain.yxdb");
+	const unsigned blockSizes[] = { SRC::LZFMinBlockSize, 0x9000, SRC::LZFDefaultBlockSize, SRC::LZFMaxBlockSize };
+	for (unsigned x = 0; x<sizeof(blockSizes)/sizeof(*blockSizes); ++x)
+	{
+		std::vector<unsigned char> vData = WriteTestMemory(NumTestRecords, [&](YXDB &fileOut)
+		{
+			fileOut.SetBlockSize(blockSizes[x]);
+			fileOut.SetCompressionThreads(x%2 * 2);
+		});
+		const Alteryx::OpenYXDB::Header *pHeader = reinterpret_cast<const Alteryx::OpenYXDB::Header *>(&vData[0]);
+		bool bRecorded = (pHeader->userHdr.nFormatFlags & Alteryx::OpenYXDB::FF_BlockSize)!=0;
+		Check(bRecorded==(blockSizes[x]!=SRC::LZFDefaultBlockSize) && pHeader->GetBlockSize()==blockSizes[x], L"the block size isn't recorded in the header");
+
+		YXDB file;
+		file.SetDecompressionThreads((x+1)%2 * 2);
+		file.OpenFromMemory(&vData[0], vData.size());
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+
+		if (bRecorded)
+		{
+			std::vector<unsigned char> vBad = vData;
+			reinterpret_cast<Alteryx::OpenYXDB::Header *>(&vBad[0])->userHdr.nBlockSize = SRC::LZFMaxBlockSize*2;
+			YXDB bad;
+			Check(Throws([&] { bad.OpenFromMemory(&vBad[0], vBad.size()); }), L"a file with a block size out of range was opened");
+		}
+	}
+
+	YXDB fileOut;
+	Check(Throws([&] { fileOut.SetBlockSize(SRC::LZFMinBlockSize-1); }), L"a block size under the minimum was taken");
+	Check(Throws([&] { fileOut.SetBlockSize(SRC::LZFMaxBlockSize+1); }), L"a block size over the maximum was taken");
+}
+
+// the blocks of the directory, read on several threads at once and put together in order, have to be the records
+// exactly as the uncompressed file has them.  That goes for a stream too, which finds its directory from the trailer
+void TestBlockDirectoryReads()
+{
+	std::vector<unsigned char> vUncompressed = UncompressedTestMemory();
+	const Alteryx::OpenYXDB::Header *pUncompressed = reinterpret_cast<const Alteryx::OpenYXDB::Header *>(&vUncompressed[0]);
+	std::vector<unsigned char> vRecords(vUncompressed.begin()+FirstBlockPos(vUncompressed), vUncompressed.begin()+size_t(pUncompressed->userHdr.nRecordBlockIndexPos));
+
+	for (unsigned x = 0; x<2; ++x)
+	{
+		WriteTestFile(L"test_blocks.yxdb", NumTestRecords, [&](YXDB &fileOut)
+		{
+			fileOut.SetBlockSize(0x4000);
+			fileOut.SetBlockDirectory();
+			fileOut.SetChecksums();
+			fileOut.SetStreamOutput(x==1);
+		});
+
+		YXDB file;
+		file.Open(L"test_blocks.yxdb");
+		const std::vector<SRC::LZFBlockEntry> &vDirectory = file.GetBlockDirectory();
+		Check(vDirectory.size()>100, L"the file should have lots of blocks");
+
+		std::vector<std::vector<unsigned char> > vBlocks(vDirectory.size());
+		std::atomic<size_t> nNextBlock(0);
+		std::atomic<bool> bFailed(false);
+		std::vector<std::thread> vThreads;
+		for (unsigned nThread = 0; nThread<4; ++nThread)
+		{
+			vThreads.push_back(std::thread([&]
+			{
+				try
+				{
+					for (size_t nBlock = nNextBlock++; nBlock<vBlocks.size(); nBlock = nNextBlock++)
+						file.ReadBlock(nBlock, vBlocks[nBlock]);
+				}
+				catch (SRC::Error)
+				{
+					bFailed = true;
+				}
+			}));
+		}
+		for (size_t n = 0; n<vThreads.size(); ++n)
+			vThreads[n].join();
+		Check(!bFailed, L"ReadBlock failed on a thread");
+
+		std::vector<unsigned char> vJoined;
+		for (size_t nBlock = 0; nBlock<vBlocks.size(); ++nBlock)
+		{
+			Check(vBlocks[nBlock].size()==vDirectory[nBlock].nSize, L"a block isn't the size the directory says");
+			vJoined.insert(vJoined.end(), vBlocks[nBlock].begin(), vBlocks[nBlock].end());
+		}
+		Check(vJoined==vRecords, L"the blocks of the directory aren't the records");
+
+		std::vector<unsigned char> vBlock;
+		Check(Throws([&] { file.ReadBlock(vDirectory.size(), vBlock); }), L"a block past the end of the directory was read");
+		// ReadBlock doesn't move the reader
+		CheckTestRecord(file.m_recordInfo, file.ReadRecord(), 0);
+	}
+}
+
+// records in place have to be the same bytes as copied out ones.  Small blocks put lots of records across block
+// edges, where they have to be copied after all, and the mixed file has uncompressed blocks used straight from the map
+void TestZeroCopy()
+{
+	WriteTestFile(L"test_plain.yxdb");
+	WriteTestFile(L"test_zerocopy.yxdb", NumTestRecords, [](YXDB &fileOut) { fileOut.SetBlockSize(0x1000); });
+	const YXDB::E_FileAccess accesses[] = { YXDB::FA_Default, YXDB::FA_MemoryMapped, YXDB::FA_ReadAhead };
+	for (unsigned x = 0; x<sizeof(accesses)/sizeof(*accesses); ++x)
+	{
+		YXDB file;
+		file.SetZeroCopy();
+		file.SetDecompressionThreads(x==0 ? 2 : 0);
+		file.Open(L"test_zerocopy.yxdb", accesses[x]);
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+
+		file.GoRecord(100000);
+		CheckTestRecord(file.m_recordInfo, file.ReadRecord(), 100000);
+	}
+
+	WriteMixedFile(L"test_mixed_plain.yxdb", false, 0);
+	YXDB mixed;
+	mixed.SetZeroCopy();
+	mixed.Open(L"test_mixed_plain.yxdb", YXDB::FA_MemoryMapped);
+	CheckSameAsPlain(mixed, L"test_mixed_plain.yxdb");
+
+	// an uncompressed file just reads the usual way
+	std::vector<unsigned char> vUncompressed = UncompressedTestMemory();
+	YXDB uncompressed;
+	uncompressed.SetZeroCopy();
+	uncompressed.OpenFromMemory(&vUncompressed[0], vUncompressed.size());
+	CheckSameAsPlain(uncompressed, L"test_plain.yxdb");
+}
+
+// the same as CheckSameAsPlain, for a file read with SetProjection: each of its fields has to be the same as that
+// field of the whole record from the plain read
+void CheckProjectedSameAsPlain(YXDB &file, const wchar_t *pFile)
+{
+	YXDB plain;
+	plain.Open(pFile);
+	for (;;)
+	{
+		const SRC::RecordData *pRec = file.ReadRecord();
+		const SRC::RecordData *pPlain = plain.ReadRecord();
+		Check((pRec==NULL)==(pPlain==NULL), L"a different number of records than a plain read");
+		if (pRec==NULL)
+			break;
+		for (unsigned x = 0; x<file.m_recordInfo.NumFields(); ++x)
+		{
+			const SRC::FieldBase *pField = file.m_recordInfo[x];
+			const SRC::FieldBase *pPlainField = plain.m_recordInfo.GetFieldByName(pField->GetFieldName());
+			Check(SRC::AString(pField->GetAsAString(pRec).value.pValue)==pPlainField->GetAsAString(pPlain).value.pValue, L"a projected field is different to a plain read");
+		}
+	}
+}
+
+// a projection has just the fields asked for, in that order, and they have to be the same as in the whole record -
+// whether or not the var data can be skipped, and one record, a batch or a scan at a time
+void TestProjection()
+{
+	WriteTestFile(L"test_plain.yxdb");
+	WriteTestFile(L"test_projection.yxdb", NumTestRecords, [](YXDB &fileOut) { fileOut.SetBlockSize(0x4000); });
+
+	std::vector<SRC::WStringNoCase> vFixed;
+	vFixed.push_back(L"Number");
+	vFixed.push_back(L"Index");
+	std::vector<SRC::WStringNoCase> vVar;
+	vVar.push_back(L"English");
+	vVar.push_back(L"Index");
+	const std::vector<SRC::WStringNoCase> *projections[] = { &vFixed, &vVar };
+	for (unsigned x = 0; x<sizeof(projections)/sizeof(*projections); ++x)
+	{
+		for (unsigned nZeroCopy = 0; nZeroCopy<2; ++nZeroCopy)
+		{
+			YXDB file;
+			file.SetZeroCopy(nZeroCopy==1);
+			file.Open(L"test_projection.yxdb", *projections[x]);
+			Check(file.m_recordInfo.NumFields()==2 && file.m_recordInfo[0]->GetFieldName()==(*projections[x])[0].c_str(), L"the projection doesn't have the fields asked for");
+			CheckProjectedSameAsPlain(file, L"test_plain.yxdb");
+
+			file.GoRecord(65530);
+			Check(CheckTestBatches(file, 7000, 65530)==NumTestRecords, L"the projected batches didn't read every record");
+		}
+
+		YXDB file;
+		file.Open(L"test_projection.yxdb", *projections[x]);
+		std::vector<unsigned char> vSeen(NumTestRecords, 0);
+		file.ParallelScan(3, [&](unsigned, const SRC::RecordInfo &recordInfo, __int64 nRecord, const SRC::RecordData *pRec)
+		{
+			Check(recordInfo.NumFields()==2, L"ParallelScan didn't give the projected record");
+			CheckTestRecord(recordInfo, pRec, nRecord);
+			vSeen[size_t(nRecord)]++;
+		});
+		Check(std::count(vSeen.begin(), vSeen.end(), 1)==NumTestRecords, L"the projected ParallelScan didn't read every record once");
+	}
+
+	YXDB file;
+	std::vector<SRC::WStringNoCase> vMissing(1, SRC::WStringNoCase(L"NotAField"));
+	Check(Throws([&] { file.Open(L"test_projection.yxdb", vMissing); }), L"a projection of a field that isn't there was opened");
+}
+
+// a field of every type ColumnBatch decodes, with some of each NULL, so the columns can be checked against the FieldBase reads
+void WriteColumnTypesFile(const wchar_t *pFile, unsigned nNumRecords)
+{
+	SRC::RecordInfo recordInfo;
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"Bool", SRC::E_FT_Bool));
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"Byte", SRC::E_FT_Byte));
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"Int16", SRC::E_FT_Int16));
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"Int32", SRC::E_FT_Int32));
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"Int64", SRC::E_FT_Int64));
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"Float", SRC::E_FT_Float));
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"Double", SRC::E_FT_Double));
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"FixedDecimal", SRC::E_FT_FixedDecimal, 19, 4));
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"String", SRC::E_FT_String, 256));
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"V_String", SRC::E_FT_V_String, 256));
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"Date", SRC::E_FT_Date));
+	recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"Blob", SRC::E_FT_Blob));
+	// the wide fields store wchar_t's, which RecordLib only converts to and from when they are 2 bytes
+	if (sizeof(wchar_t)==2)
+	{
+		recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"WString", SRC::E_FT_WString, 256));
+		recordInfo.AddField(SRC::RecordInfo::CreateFieldXml(L"V_WString", SRC::E_FT_V_WString, 256));
+	}
+
+	const TestValues &values = GetTestValues();
+	YXDB fileOut;
+	fileOut.Create(pFile, recordInfo.GetRecordXmlMetaData());
+	const SRC::RecordInfo &ri = fileOut.m_recordInfo;
+	SRC::SmartPointerRefObj<SRC::Record> pRec = ri.CreateRecord();
+	for (unsigned x = 0; x<nNumRecords; ++x)
+	{
+		pRec->Reset();
+		const SRC::AString &strEnglish = values.vEnglish[x];
+		char date[16];
+		sprintf(date, "2024-%02u-%02u", 1 + x%12, 1 + x%28);
+
+		ri[0]->SetFromInt32(pRec.Get(), x%3==0);
+		ri[1]->SetFromInt32(pRec.Get(), x%200);
+		ri[2]->SetFromInt32(pRec.Get(), int(x%30000) - 15000);
+		ri[3]->SetFromInt64(pRec.Get(), __int64(x)*7 - 100000);
+		ri[4]->SetFromInt64(pRec.Get(), __int64(x)*1000003);
+		ri[5]->SetFromDouble(pRec.Get(), x*0.25);
+		ri[6]->SetFromDouble(pRec.Get(), values.vNumbers[x]/3.0);
+		ri[7]->SetFromDouble(pRec.Get(), x/8.0);
+		ri[8]->SetFromString(pRec.Get(), strEnglish);
+		ri[9]->SetFromString(pRec.Get(), strEnglish);
+		ri[10]->SetFromString(pRec.Get(), date);
+		ri[11]->SetFromBlob(pRec.Get(), SRC::BlobVal(strEnglish.Length(), strEnglish.c_str()));
+		for (unsigned nField = 12; nField<ri.NumFields(); ++nField)
+			ri[nField]->SetFromString(pRec.Get(), SRC::ConvertToWString(strEnglish));
+
+		// a different record is NULL for each field
+		for (unsigned nField = 0; nField<ri.NumFields(); ++nField)
+		{
+			if ((x + nField)%11==0)
+				ri[nField]->SetNull(pRec.Get());
+		}
+		fileOut.AppendRecord(pRec->GetRecord());
+	}
+	fileOut.Close();
+}
+
+// reads the rest of file with ReadColumns in batches of nBatchSize, checking every value of every column against the
+// same field of a plain read of pPlainFile, from nFirstRecord on.  Returns the # of the record after the last
+__int64 CheckColumnsSameAsPlain(YXDB &file, size_t nBatchSize, const wchar_t *pPlainFile, __int64 nFirstRecord = 0)
+{
+	YXDB plain;
+	plain.Open(pPlainFile);
+	plain.GoRecord(nFirstRecord);
+
+	Alteryx::OpenYXDB::ColumnBatch columns;
+	__int64 nRecord = nFirstRecord;
+	while (file.ReadColumns(columns, nBatchSize)!=0)
+	{
+		Check(columns.GetFirstRecord()==nRecord && columns.size()<=nBatchSize, L"a column batch is out of place");
+		Check(columns.NumColumns()==file.m_recordInfo.NumFields(), L"there isn't a column for each field");
+		for (size_t nRow = 0; nRow<columns.size(); ++nRow, ++nRecord)
+		{
+			const SRC::RecordData *pPlain = plain.ReadRecord();
+			Check(pPlain!=NULL, L"there are more rows than a plain read has records");
+			for (size_t nColumn = 0; nColumn<columns.NumColumns(); ++nColumn)
+			{
+				const Alteryx::OpenYXDB::ColumnBatch::Column &column = columns[nColumn];
+				const SRC::FieldBase *pField = plain.m_recordInfo.GetFieldByName(file.m_recordInfo[column.nField]->GetFieldName());
+				bool bValid = Alteryx::OpenYXDB::ColumnBatch::GetBit(column.vValidity, nRow);
+				Check(bValid==!pField->GetNull(pPlain), L"a column's NULL is different to a plain read");
+				if (!bValid)
+					continue;
+
+				const char *pData = column.vOffsets.empty() ? NULL : column.vData.data() + column.vOffsets[nRow];
+				size_t nLen = column.vOffsets.empty() ? 0 : size_t(column.vOffsets[nRow+1] - column.vOffsets[nRow]);
+				switch (column.type)
+				{
+					case Alteryx::OpenYXDB::ColumnBatch::CT_Bool:
+						Check(Alteryx::OpenYXDB::ColumnBatch::GetBit(column.vBits, nRow)==pField->GetAsBool(pPlain).value, L"a bool column is different to a plain read");
+						break;
+					case Alteryx::OpenYXDB::ColumnBatch::CT_Int64:
+						Check(column.vInt64[nRow]==pField->GetAsInt64(pPlain).value, L"an int column is different to a plain read");
+						break;
+					case Alteryx::OpenYXDB::ColumnBatch::CT_Double:
+						Check(column.vDouble[nRow]==pField->GetAsDouble(pPlain).value, L"a double column is different to a plain read");
+						break;
+					case Alteryx::OpenYXDB::ColumnBatch::CT_String:
+						Check(SRC::AString(pField->GetAsAString(pPlain).value.pValue)==SRC::AString(pData, unsigned(nLen)), L"a string column is different to a plain read");
+						break;
+					case Alteryx::OpenYXDB::ColumnBatch::CT_WString:
+					{
+						SRC::WStringVal val = pField->GetAsWString(pPlain).value;
+						Check(nLen==val.nLength*sizeof(wchar_t) && memcmp(pData, val.pValue, nLen)==0, L"a wide string column is different to a plain read");
+						break;
+					}
+					case Alteryx::OpenYXDB::ColumnBatch::CT_Binary:
+					{
+						SRC::BlobVal val = pField->GetAsBlob(pPlain).value;
+						Check(nLen==val.nLength && memcmp(pData, val.pValue, nLen)==0, L"a binary column is different to a plain read");
+						break;
+					}
+				}
+			}
+		}
+	}
+	Check(plain.ReadRecord()==NULL, L"there are fewer rows than a plain read has records");
+	return nRecord;
+}
+
+// ReadColumns has to decode every type the same as the FieldBase reads do, NULLs included, in batches that cross the
+// 64K record blocks, after a GoRecord, with a projection, and straight out of a mapped file
+void TestColumns()
+{
+	const unsigned nNumRecords = 70000;
+	WriteColumnTypesFile(L"test_columns.yxdb", nNumRecords);
+
+	size_t batchSizes[] = { 1, 1000, 65536, 100000 };
+	for (unsigned x = 0; x<sizeof(batchSizes)/sizeof(*batchSizes); ++x)
+	{
+		// one row at a time is slow, so that is only checked across the block boundary
+		__int64 nFirstRecord = batchSizes[x]==1 ? 65000 : 0;
+		YXDB file;
+		file.Open(L"test_columns.yxdb");
+		file.GoRecord(nFirstRecord);
+		Check(CheckColumnsSameAsPlain(file, batchSizes[x], L"test_columns.yxdb", nFirstRecord)==nNumRecords, L"ReadColumns didn't read every record");
+	}
+
+	YXDB file;
+	file.SetZeroCopy(true);
+	file.Open(L"test_columns.yxdb", YXDB::FA_MemoryMapped);
+	Check(CheckColumnsSameAsPlain(file, 10000, L"test_columns.yxdb")==nNumRecords, L"ReadColumns didn't read every mapped record");
+
+	std::vector<SRC::WStringNoCase> vFields;
+	vFields.push_back(L"Blob");
+	vFields.push_back(L"Int16");
+	vFields.push_back(L"String");
+	vFields.push_back(L"Bool");
+	YXDB projected;
+	projected.Open(L"test_columns.yxdb", vFields);
+	Check(CheckColumnsSameAsPlain(projected, 30000, L"test_columns.yxdb")==nNumRecords, L"ReadColumns didn't read every projected record");
+
+	// and the test file's own fields
+	WriteTestFile(L"test_plain.yxdb");
+	YXDB test;
+	test.SetDecompressionThreads(2);
+	test.Open(L"test_plain.yxdb");
+	Check(CheckColumnsSameAsPlain(test, 50000, L"test_plain.yxdb")==NumTestRecords, L"ReadColumns didn't read every test record");
+}
+
+// direct I/O only changes how the file is written, so it has to read back the same as a plain one - the
+// header rewrite at the end included.  The small file never fills an aligned block, so it is all tail
+void TestDirectIO()
+{
+	const unsigned sizes[] = { 10, NumTestRecords };
+	for (unsigned x = 0; x<sizeof(sizes)/sizeof(*sizes); ++x)
+	{
+		WriteTestFile(L"test_plain.yxdb", sizes[x]);
+
+		YXDB fileOut;
+		fileOut.SetDirectIO();
+		fileOut.SetExpectedSize(__int64(sizes[x])*64);
+		fileOut.Create(L"test_direct.yxdb", TestRecordXml());
+		AppendTestRecords(fileOut, sizes[x]);
+		fileOut.Close();
+
+		YXDB file;
+		file.Open(L"test_direct.yxdb");
+		Check(file.GetNumRecords()==sizes[x], L"the wrong record count after direct I/O");
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+		file.GoRecord(sizes[x]-1);
+		CheckTestRecord(file.m_recordInfo, file.ReadRecord(), sizes[x]-1);
+	}
+}
+
+// the compression threads have to give the same file as compressing in line, many small blocks in flight at once.
+// Each writer joins its threads in Close, so doing it over and over doesn't pile them up
+void TestCompressionThreads()
+{
+	WriteTestFile(L"test_plain.yxdb");
+	for (unsigned x = 0; x<6; ++x)
+	{
+		YXDB fileOut;
+		fileOut.SetCompressionThreads(1 + x%4);
+		fileOut.SetBlockSize(0x4000);
+		fileOut.Create(L"test_threads.yxdb", TestRecordXml());
+		AppendTestRecords(fileOut);
+		fileOut.Close();
+
+		YXDB file;
+		file.Open(L"test_threads.yxdb");
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+	}
+}
+
+// the read ahead threads have to give the same records as decompressing in line, including after jumping around
+// with blocks still in flight.  Each reader joins its threads and gives its buffers back to the pool in Close
+void TestDecompressionThreads()
+{
+	WriteTestFile(L"test_plain.yxdb");
+	{
+		YXDB fileOut;
+		fileOut.SetBlockSize(0x4000);
+		fileOut.Create(L"test_threads.yxdb", TestRecordXml());
+		AppendTestRecords(fileOut);
+		fileOut.Close();
+	}
+
+	std::shared_ptr<SRC::LZFBufferPool> pPool(new SRC::LZFBufferPool);
+	for (unsigned x = 0; x<6; ++x)
+	{
+		YXDB file;
+		file.SetDecompressionThreads(1 + x%4);
+		file.SetBufferPool(pPool);
+		file.Open(L"test_threads.yxdb");
+		CheckTestRecord(file.m_recordInfo, file.ReadRecord(), 0);
+		file.GoRecord(120000);
+		CheckTestRecord(file.m_recordInfo, file.ReadRecord(), 120000);
+		file.GoRecord(0);
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+	}
+}
+
+// batches that don't divide the 64K record blocks have to carry on across them
+void TestReadRecords()
+{
+	std::vector<unsigned char> vData = WriteTestMemory();
+	const size_t batchSizes[] = { 1, 1000, 7000, 65536, 70000 };
+	for (unsigned x = 0; x<sizeof(batchSizes)/sizeof(*batchSizes); ++x)
+	{
+		YXDB file;
+		file.OpenFromMemory(&vData[0], vData.size());
+		Check(CheckTestBatches(file, batchSizes[x])==NumTestRecords, L"the batches didn't read every record");
+	}
+
+	YXDB file;
+	file.OpenFromMemory(&vData[0], vData.size());
+	file.GoRecord(65000);
+	Check(CheckTestBatches(file, 1000, 65000)==NumTestRecords, L"the batches didn't read every record after a GoRecord");
+
+	// a header that claims another record, so the data runs out partway through it
+	reinterpret_cast<Alteryx::OpenYXDB::Header *>(&vData[0])->userHdr.nNumRecords++;
+	YXDB truncated;
+	truncated.OpenFromMemory(&vData[0], vData.size());
+	Check(Throws([&] { Alteryx::OpenYXDB::RecordBatch batch; while (truncated.ReadRecords(batch, 7000)!=0) {} }), L"a short read didn't throw");
+}
+
+// GoRecord in random order over lots of small blocks has to land on the same records as a sequential read - from
+// the block a record is in with a block directory, or from its 64K record block through the record block index
+void TestBlockDirectory()
+{
+	for (unsigned x = 0; x<2; ++x)
+	{
+		bool bDirectory = x==0;
+		{
+			YXDB fileOut;
+			fileOut.SetBlockSize(0x1000);
+			fileOut.SetBlockDirectory(bDirectory);
+			fileOut.Create(L"test_directory.yxdb", TestRecordXml());
+			AppendTestRecords(fileOut);
+			fileOut.Close();
+		}
+
+		YXDB file;
+		file.Open(L"test_directory.yxdb");
+		const std::vector<SRC::LZFBlockEntry> &vDirectory = file.GetBlockDirectory();
+		Check(vDirectory.empty()!=bDirectory, L"the block directory is missing or shouldn't be there");
+
+		// each block's first record starts where the directory says it does.  The Index field is first in the record
+		std::vector<unsigned char> vBlock;
+		__int64 nPrevFirstRecord = 0;
+		for (size_t nBlock = 0; nBlock<vDirectory.size(); ++nBlock)
+		{
+			const SRC::LZFBlockEntry &entry = vDirectory[nBlock];
+			file.ReadBlock(nBlock, vBlock);
+			Check(vBlock.size()==entry.nSize && entry.nFirstRecord>=nPrevFirstRecord, L"a block doesn't match the block directory");
+			if (entry.nFirstRecordOffset+sizeof(__int64)<=entry.nSize)
+			{
+				__int64 nIndex;
+				memcpy(&nIndex, &vBlock[entry.nFirstRecordOffset], sizeof(nIndex));
+				Check(nIndex==entry.nFirstRecord, L"a block's first record isn't where the block directory says");
+			}
+			nPrevFirstRecord = entry.nFirstRecord;
+		}
+		Check(bDirectory==false || vDirectory.size()>100, L"the file should have lots of blocks");
+
+		std::vector<__int64> vRecords;
+		for (__int64 nRecord = 0; nRecord<NumTestRecords; nRecord += 397)
+			vRecords.push_back(nRecord);
+		vRecords.push_back(NumTestRecords-1);
+		std::shuffle(vRecords.begin(), vRecords.end(), std::mt19937());
+		for (size_t n = 0; n<vRecords.size(); ++n)
+		{
+			file.GoRecord(vRecords[n]);
+			CheckTestRecord(file.m_recordInfo, file.ReadRecord(), vRecords[n]);
+		}
+
+		// and on from the middle of a block, across the next 64K record block
+		file.GoRecord(65000);
+		Check(CheckTestRecords(file, 65000)==NumTestRecords, L"the records after a GoRecord didn't read to the end");
+	}
+}
+
+// the same records as WriteSampleFile, written to memory with the given compression
+std::vector<unsigned char> WriteSampleMemory(SRC::E_BlockCodec codec, int nLevel, bool bChecksums = false)
+{
+	SRC::RecordInfo recordInfoOut;
+	recordInfoOut.AddField(SRC::RecordInfo::CreateFieldXml(L"Number", SRC::E_FT_Double));
+	recordInfoOut.AddField(SRC::RecordInfo::CreateFieldXml(L"English", SRC::E_FT_V_String, 256));
+
+	std::vector<unsigned char> vData;
+	Alteryx::OpenYXDB::Open_AlteryxYXDB fileOut;
+	fileOut.SetCompression(codec, nLevel);
+	fileOut.SetChecksums(bChecksums);
+	fileOut.CreateInMemory(vData, recordInfoOut.GetRecordXmlMetaData());
+
+	SRC::SmartPointerRefObj<SRC::Record> pRec = recordInfoOut.CreateRecord();
+	std::mt19937 r;
+	for (unsigned x = 0; x<100; ++x)
+	{
+		pRec->Reset();
+		int v = r();
+		recordInfoOut[0]->SetFromInt32(pRec.Get(), v);
+		recordInfoOut[1]->SetFromString(pRec.Get(), EnglishNumber(v));
+		fileOut.AppendRecord(pRec->GetRecord());
+	}
+	fileOut.Close();
+	return vData;
+}
+
+// reads every record back and compares it to what WriteSampleMemory wrote
+void CheckSampleMemory(const std::vector<unsigned char> &vData)
+{
+	Alteryx::OpenYXDB::Open_AlteryxYXDB file;
+	file.OpenFromMemory(&vData[0], vData.size());
+
+	std::mt19937 r;
+	unsigned nNumRecords = 0;
+	while (const SRC::RecordData *pRec = file.ReadRecord())
+	{
+		int v = r();
+		Check(file.m_recordInfo[0]->GetAsDouble(pRec).value==double(v), L"the Number field doesn't match");
+		Check(EnglishNumber(v)==file.m_recordInfo[1]->GetAsAString(pRec).value.pValue, L"the English field doesn't match");
+		nNumRecords++;
+	}
+	Check(nNumRecords==100, L"the wrong number of records");
+}
+
+// every level writes plain LZF, so the original lzf_decompress has to be able to read all of them
+void TestLZFLevels()
+{
+	const int levels[] = { SRC::LZF_Fast, SRC::LZF_Default, SRC::LZF_Better, SRC::LZF_Best };
+	for (unsigned nLevel = 0; nLevel<sizeof(levels)/sizeof(*levels); ++nLevel)
+	{
+		SRC::BlockCodec codec(SRC::BC_LZF, levels[nLevel]);
+		for (unsigned nTest = 0; nTest<8; ++nTest)
+		{
+			std::vector<unsigned char> vIn = TestBuffer(1 + nTest*37000, (nTest & 1)==0, nTest);
+			std::vector<unsigned char> vCompressed(vIn.size() + vIn.size()/16 + 64);
+			unsigned nCompressed = codec.Compress(&vIn[0], unsigned(vIn.size()), &vCompressed[0], unsigned(vCompressed.size()));
+			Check(nCompressed>0, L"an LZF level couldn't compress a block");
+
+			std::vector<unsigned char> vOut(vIn.size());
+			unsigned nOut = lzf_decompress(&vCompressed[0], nCompressed, &vOut[0], unsigned(vOut.size()));
+			Check(nOut==vIn.size() && vOut==vIn, L"an LZF level doesn't decompress with lzf_decompress");
+		}
+
+		CheckSampleMemory(WriteSampleMemory(SRC::BC_LZF, levels[nLevel]));
+	}
+
+	// and a whole file of small blocks at each level, compressed on threads that each have their own hash table
+	WriteTestFile(L"test_plain.yxdb");
+	for (unsigned nLevel = 0; nLevel<sizeof(levels)/sizeof(*levels); ++nLevel)
+	{
+		WriteTestFile(L"test_levels.yxdb", NumTestRecords, [&](YXDB &fileOut)
+		{
+			fileOut.SetCompression(SRC::BC_LZF, levels[nLevel]);
+			fileOut.SetBlockSize(0x4000);
+			fileOut.SetCompressionThreads(3);
+		});
+
+		YXDB file;
+		file.Open(L"test_levels.yxdb");
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+	}
+}
+
+// decompresses with lzf_decompress and the wide decoder lzf_decompress_select picks, and checks they agree -
+// and that neither writes past nOutLen, even when that is too small.  Returns what they returned
+unsigned CheckWideDecompress(const std::vector<unsigned char> &vIn, unsigned nOutLen)
+{
+	static const lzf_decompress_fn pfnWide = lzf_decompress_select();
+
+	// anything written here is past the end of the output
+	const unsigned GuardSize = 64;
+	std::vector<unsigned char> vBase(nOutLen+GuardSize, 0xa5);
+	std::vector<unsigned char> vWide(nOutLen+GuardSize, 0xa5);
+	unsigned nBase = lzf_decompress(&vIn[0], unsigned(vIn.size()), &vBase[0], nOutLen);
+	unsigned nWide = pfnWide(&vIn[0], unsigned(vIn.size()), &vWide[0], nOutLen);
+
+	Check(nBase==nWide, L"the wide decoder returned something different");
+	Check(std::equal(vBase.begin(), vBase.begin()+nBase, vWide.begin()), L"the wide decoder decompressed something different");
+	for (unsigned x = nOutLen; x<nOutLen+GuardSize; ++x)
+		Check(vBase[x]==0xa5 && vWide[x]==0xa5, L"a decoder wrote past the end of the output");
+	return nWide;
+}
+
+// a literal run of nDistance bytes, a back reference of nLength bytes from nDistance back - which overlaps what
+// it is writing when nDistance<nLength - and then a literal run of nTail bytes at the very end of the output
+std::vector<unsigned char> LZFBackReference(unsigned nDistance, unsigned nLength, unsigned nTail)
+{
+	std::vector<unsigned char> vData;
+	vData.push_back((unsigned char)(nDistance-1));
+	for (unsigned x = 0; x<nDistance; ++x)
+		vData.push_back((unsigned char)('a'+x));
+
+	unsigned nOffset = nDistance-1;
+	unsigned nLen = nLength-2;
+	if (nLen<7)
+		vData.push_back((unsigned char)((nLen<<5) | (nOffset>>8)));
+	else
+	{
+		vData.push_back((unsigned char)((7<<5) | (nOffset>>8)));
+		vData.push_back((unsigned char)(nLen-7));
+	}
+	vData.push_back((unsigned char)(nOffset & 0xff));
+
+	if (nTail>0)
+	{
+		vData.push_back((unsigned char)(nTail-1));
+		for (unsigned x = 0; x<nTail; ++x)
+			vData.push_back((unsigned char)('A'+x));
+	}
+	return vData;
+}
+
+void TestWideDecompress()
+{
+	// LZF's back references go from 3 to 264 bytes, and literal runs from 1 to 32
+	const unsigned lengths[] = { 3, 4, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 264 };
+	const unsigned tails[] = { 0, 1, 7, 8, 15, 16, 31, 32 };
+	for (unsigned nDistance = 1; nDistance<=16; ++nDistance)
+	{
+		for (unsigned nLength = 0; nLength<sizeof(lengths)/sizeof(*lengths); ++nLength)
+		{
+			for (unsigned nTail = 0; nTail<sizeof(tails)/sizeof(*tails); ++nTail)
+			{
+				std::vector<unsigned char> vIn = LZFBackReference(nDistance, lengths[nLength], tails[nTail]);
+				unsigned nSize = nDistance + lengths[nLength] + tails[nTail];
+				Check(CheckWideDecompress(vIn, nSize)==nSize, L"an overlapping back reference didn't decompress");
+				Check(CheckWideDecompress(vIn, nSize-1)==0, L"a decoder didn't notice the output was too small");
+				Check(CheckWideDecompress(vIn, nDistance)==0, L"a decoder didn't notice the output was too small");
+			}
+		}
+	}
+
+	for (unsigned nTest = 0; nTest<16; ++nTest)
+	{
+		std::vector<unsigned char> vIn = TestBuffer(1 + nTest*20011, (nTest & 1)==0, 100+nTest);
+		std::vector<unsigned char> vCompressed(vIn.size() + vIn.size()/16 + 64);
+		unsigned nCompressed = lzf_compress(&vIn[0], unsigned(vIn.size()), &vCompressed[0], unsigned(vCompressed.size()));
+		Check(nCompressed>0, L"lzf_compress couldn't compress a block");
+		vCompressed.resize(nCompressed);
+
+		unsigned nSize = unsigned(vIn.size());
+		Check(CheckWideDecompress(vCompressed, nSize)==nSize, L"a block didn't decompress");
+		Check(CheckWideDecompress(vCompressed, nSize-1)==0, L"a decoder didn't notice the output was too small");
+		Check(CheckWideDecompress(vCompressed, nSize/2)==0 || nSize<2, L"a decoder didn't notice the output was too small");
+	}
+
+	// every block of a real file, found through its block directory
+	std::vector<unsigned char> vFile = WriteTestMemory(NumTestRecords, [](YXDB &fileOut)
+	{
+		fileOut.SetBlockSize(0x4000);
+		fileOut.SetBlockDirectory();
+	});
+	YXDB file;
+	file.OpenFromMemory(&vFile[0], vFile.size());
+	const std::vector<SRC::LZFBlockEntry> &vDirectory = file.GetBlockDirectory();
+	Check(vDirectory.size()>100, L"the file should have lots of blocks");
+	for (size_t nBlock = 0; nBlock<vDirectory.size(); ++nBlock)
+	{
+		unsigned nBlockLen;
+		memcpy(&nBlockLen, &vFile[size_t(vDirectory[nBlock].nPos)], sizeof(nBlockLen));
+		if (nBlockLen & 0x80000000)
+			continue;
+		const unsigned char *pBlock = &vFile[size_t(vDirectory[nBlock].nPos)+sizeof(nBlockLen)];
+		std::vector<unsigned char> vBlock(pBlock, pBlock+nBlockLen);
+		Check(CheckWideDecompress(vBlock, vDirectory[nBlock].nSize)==vDirectory[nBlock].nSize, L"a block of the file didn't decompress");
+	}
+
+	// and the reader, which decompresses with the wide decoder on its threads
+	WriteTestFile(L"test_plain.yxdb");
+	YXDB threaded;
+	threaded.SetDecompressionThreads(3);
+	threaded.OpenFromMemory(&vFile[0], vFile.size());
+	CheckSameAsPlain(threaded, L"test_plain.yxdb");
+}
+
+// one bit at a time, straight from the definition
+unsigned Crc32cReference(const unsigned char *pData, size_t nSize)
+{
+	unsigned crc = 0xffffffff;
+	for (size_t x = 0; x<nSize; ++x)
+	{
+		crc ^= pData[x];
+		for (int nBit = 0; nBit<8; ++nBit)
+			crc = (crc>>1) ^ (0x82f63b78 & (0u-(crc & 1)));
+	}
+	return ~crc;
+}
+
+void TestChecksums()
+{
+	static const lzf_crc32c_fn pfnCrc = lzf_crc32c_select();
+	Check(pfnCrc(0, "123456789", 9)==0xe3069283, L"CRC32C(\"123456789\") is wrong");
+	Check(pfnCrc(pfnCrc(0, "1234", 4), "56789", 5)==0xe3069283, L"CRC32C in pieces is wrong");
+
+	// every length and alignment the 8 byte steps have to deal with
+	std::vector<unsigned char> vData = TestBuffer(200, false, 18);
+	for (size_t nStart = 0; nStart<8; ++nStart)
+		for (size_t nSize = 0; nSize+nStart<=vData.size(); ++nSize)
+			Check(pfnCrc(0, &vData[nStart], unsigned(nSize))==Crc32cReference(&vData[nStart], nSize), L"CRC32C doesn't match the reference");
+
+	std::vector<unsigned char> vChecked = WriteSampleMemory(SRC::BC_LZF, SRC::LZF_Default, true);
+	CheckSampleMemory(vChecked);
+
+	// with checksums, a block is its length, its CRC and then the data
+	size_t nBlockPos = FirstBlockPos(vChecked);
+	unsigned nBlockLen;
+	memcpy(&nBlockLen, &vChecked[nBlockPos], sizeof(nBlockLen));
+	nBlockLen &= ~0x80000000u;
+	Check(nBlockPos+8+nBlockLen<=vChecked.size(), L"the first block is past the end of the file");
+
+	// the last byte is a literal, so without the checksum it would decompress without complaint
+	std::vector<unsigned char> vFlipped = vChecked;
+	vFlipped[nBlockPos+8+nBlockLen-1] ^= 0x20;
+	Check(Throws([&]() { CheckSampleMemory(vFlipped); }), L"a block with a flipped byte was read");
+
+	std::vector<unsigned char> vBadCrc = vChecked;
+	vBadCrc[nBlockPos+4] ^= 0x01;
+	Check(Throws([&]() { CheckSampleMemory(vBadCrc); }), L"a block with the wrong checksum was read");
+
+	// lots of blocks, checked on the compression and decompression threads as well as in line
+	WriteTestFile(L"test_plain.yxdb");
+	auto setup = [](YXDB &fileOut)
+	{
+		fileOut.SetChecksums();
+		fileOut.SetBlockDirectory();
+		fileOut.SetBlockSize(0x4000);
+		fileOut.SetCompressionThreads(2);
+	};
+	WriteTestFile(L"test_checksums.yxdb", NumTestRecords, setup);
+	Check(YXDB::VerifyChecksums(L"test_checksums.yxdb"), L"VerifyChecksums didn't find the checksums");
+	for (unsigned nThreads = 0; nThreads<=3; nThreads += 3)
+	{
+		YXDB file;
+		file.SetDecompressionThreads(nThreads);
+		file.Open(L"test_checksums.yxdb");
+		CheckSameAsPlain(file, L"test_plain.yxdb");
+	}
+
+	// the same file with the CRC of a block in the middle wrong.  The data is fine, so only the checksum can catch it
+	WriteTestFile(L"test_badcrc.yxdb", NumTestRecords, setup);
+	{
+		YXDB file;
+		file.Open(L"test_badcrc.yxdb");
+		const std::vector<SRC::LZFBlockEntry> &vDirectory = file.GetBlockDirectory();
+		Check(vDirectory.size()>100, L"the file should have lots of blocks");
+		__int64 nCrcPos = vDirectory[vDirectory.size()/2].nPos + sizeof(unsigned);
+		file.Close();
+
+		Alteryx::OpenYXDB::File_Large fileUpdate;
+		fileUpdate.OpenForUpdate(L"test_badcrc.yxdb");
+		unsigned nCrc;
+		fileUpdate.ReadAt(nCrcPos, &nCrc, sizeof(nCrc));
+		nCrc ^= 0x100;
+		fileUpdate.WriteAt(nCrcPos, &nCrc, sizeof(nCrc));
+		fileUpdate.Close();
+	}
+	Check(Throws([] { YXDB::VerifyChecksums(L"test_badcrc.yxdb"); }), L"VerifyChecksums passed a block with the wrong checksum");
+	for (unsigned nThreads = 0; nThreads<=3; nThreads += 3)
+	{
+		YXDB file;
+		file.SetDecompressionThreads(nThreads);
+		file.Open(L"test_badcrc.yxdb");
+		Check(Throws([&] { CheckSameAsPlain(file, L"test_plain.yxdb"); }), L"a block with the wrong checksum was read");
+	}
+	YXDB unverified;
+	unverified.SetVerifyChecksums(false);
+	unverified.Open(L"test_badcrc.yxdb");
+	CheckSameAsPlain(unverified, L"test_plain.yxdb");
+}
+
+// shorter than LZ4's end of block margins, so these are all literals
+void TestLZ4ShortBlocks()
+{
+	for (int nLevel = 0; nLevel<=1; ++nLevel)
+	{
+		SRC::BlockCodec codec(SRC::BC_LZ4, nLevel);
+		for (unsigned nSize = 1; nSize<=64; ++nSize)
+		{
+			std::vector<unsigned char> vIn = TestBuffer(nSize, true, nSize);
+			std::vector<unsigned char> vCompressed(nSize + 16);
+			unsigned nCompressed = codec.Compress(&vIn[0], nSize, &vCompressed[0], unsigned(vCompressed.size()));
+			Check(nCompressed>0, L"LZ4 couldn't compress a short block");
+
+			std::vector<unsigned char> vOut(nSize);
+			Check(codec.Decompress(&vCompressed[0], nCompressed, &vOut[0], nSize)==nSize && vOut==vIn, L"a short LZ4 block didn't round trip");
+		}
+	}
+}
+
+void TestBlockCodecs()
+{
+	CheckSampleMemory(WriteSampleMemory(SRC::BC_LZF, SRC::LZF_Default));
+	CheckSampleMemory(WriteSampleMemory(SRC::BC_LZ4, 0));
+	CheckSampleMemory(WriteSampleMemory(SRC::BC_LZ4, 1));
+
+	std::vector<unsigned char> vLZ4 = WriteSampleMemory(SRC::BC_LZ4, 0);
+	Alteryx::OpenYXDB::Header *pHeader = reinterpret_cast<Alteryx::OpenYXDB::Header *>(&vLZ4[0]);
+	Check((pHeader->userHdr.nFormatFlags & Alteryx::OpenYXDB::FF_BlockCodec)!=0, L"an LZ4 file without FF_BlockCodec");
+
+	// a reader from before FF_BlockCodec only knows LZF, so it has to turn the file down rather than misread it
+	std::vector<unsigned char> vOldReader = vLZ4;
+	reinterpret_cast<Alteryx::OpenYXDB::Header *>(&vOldReader[0])->userHdr.nFormatFlags &= ~unsigned(Alteryx::OpenYXDB::FF_BlockCodec);
+	Check(Throws([&]() { CheckSampleMemory(vOldReader); }), L"an LZ4 file was read as LZF");
+
+	size_t nBlockPos = FirstBlockPos(vLZ4);
+	unsigned nBlockLen;
+	memcpy(&nBlockLen, &vLZ4[nBlockPos], sizeof(nBlockLen));
+	Check((nBlockLen & 0x80000000)==0 && nBlockPos+sizeof(nBlockLen)+nBlockLen<=vLZ4.size(), L"the first LZ4 block isn't compressed");
+
+	// the file ends in the middle of the block
+	std::vector<unsigned char> vTruncated(vLZ4.begin(), vLZ4.begin()+nBlockPos+sizeof(nBlockLen)+nBlockLen/2);
+	Check(Throws([&]() { CheckSampleMemory(vTruncated); }), L"a truncated LZ4 block was read");
+
+	// every literal length runs past the end of the block
+	std::vector<unsigned char> vCorrupt = vLZ4;
+	memset(&vCorrupt[nBlockPos+sizeof(nBlockLen)], 0xff, std::min(nBlockLen, 64u));
+	Check(Throws([&]() { CheckSampleMemory(vCorrupt); }), L"a corrupt LZ4 block was read");
+
+	// lots of blocks, through the threaded pipelines as well as in line
+	WriteTestFile(L"test_plain.yxdb");
+	const SRC::E_BlockCodec codecs[] = { SRC::BC_LZF, SRC::BC_LZ4, SRC::BC_LZ4 };
+	const int levels[] = { SRC::LZF_Default, 0, 1 };
+	for (unsigned nCodec = 0; nCodec<sizeof(codecs)/sizeof(*codecs); ++nCodec)
+	{
+		for (unsigned nThreads = 0; nThreads<=2; nThreads += 2)
+		{
+			WriteTestFile(L"test_codec.yxdb", NumTestRecords, [&](YXDB &fileOut)
+			{
+				fileOut.SetCompression(codecs[nCodec], levels[nCodec]);
+				fileOut.SetBlockSize(0x4000);
+				fileOut.SetCompressionThreads(nThreads);
+			});
+
+			YXDB file;
+			file.SetDecompressionThreads(2-nThreads);
+			file.Open(L"test_codec.yxdb");
+			CheckSameAsPlain(file, L"test_plain.yxdb");
+		}
+	}
+}
+
+// a stream can't have cursors, and a file of 1 block has nothing to split up, so both are scanned by the reader itself
+void TestParallelScan(const wchar_t *pFile)
+{
+	const Alteryx::OpenYXDB::Open_AlteryxYXDB::E_FileAccess accesses[] = { Alteryx::OpenYXDB::Open_AlteryxYXDB::FA_Stream, Alteryx::OpenYXDB::Open_AlteryxYXDB::FA_Default };
+	for (unsigned nAccess = 0; nAccess<sizeof(accesses)/sizeof(*accesses); ++nAccess)
+	{
+		Alteryx::OpenYXDB::Open_AlteryxYXDB file;
+		file.Open(pFile, accesses[nAccess]);
+
+		__int64 nNextRecord = 0;
+		bool bInOrder = true;
+		file.ParallelScan(4, [&](unsigned nThread, const SRC::RecordInfo &, __int64 nRecord, const SRC::RecordData *)
+		{
+			if (nThread!=0 || nRecord!=nNextRecord)
+				bInOrder = false;
+			nNextRecord++;
+		});
+		Check(bInOrder && nNextRecord==100, L"ParallelScan didn't read every record of the file in order");
+		Check(file.ReadRecord()==NULL, L"ParallelScan didn't leave the reader at the end");
+	}
+
+	// several 64K record blocks are split up between the threads.  Every record has to come out once, as itself
+	WriteTestFile(L"test_scan.yxdb");
+	const YXDB::E_FileAccess multiAccesses[] = { YXDB::FA_Default, YXDB::FA_MemoryMapped };
+	for (unsigned nAccess = 0; nAccess<sizeof(multiAccesses)/sizeof(*multiAccesses); ++nAccess)
+	{
+		YXDB file;
+		file.Open(L"test_scan.yxdb", multiAccesses[nAccess]);
+
+		// each record is only ever touched by the one thread that gets its block
+		std::vector<unsigned char> vSeen(NumTestRecords, 0);
+		std::vector<unsigned char> vThreads(4, 0);
+		file.ParallelScan(4, [&](unsigned nThread, const SRC::RecordInfo &recordInfo, __int64 nRecord, const SRC::RecordData *pRec)
+		{
+			CheckTestRecord(recordInfo, pRec, nRecord);
+			vSeen[size_t(nRecord)]++;
+			vThreads[nThread] = 1;
+		});
+		Check(std::count(vSeen.begin(), vSeen.end(), 1)==NumTestRecords, L"ParallelScan didn't read every record once");
+		Check(vThreads[3]==0, L"ParallelScan used more threads than there are record blocks");
+
+		// an error on one thread stops the others, and comes out of ParallelScan
+		Check(Throws([&]
+		{
+			file.ParallelScan(4, [](unsigned, const SRC::RecordInfo &, __int64 nRecord, const SRC::RecordData *)
+			{
+				if (nRecord==100000)
+					throw SRC::Error(L"stop");
+			});
+		}), L"an error in the ParallelScan callback was lost");
+	}
+}
+
 int _tmain(int argc, _TCHAR* argv[])
 {
 	// most of the functions in this library can throw class Error if something goes wrong
@@ -109,10 +1698,39 @@ int _tmain(int argc, _TCHAR* argv[])
 	{
 		WriteSampleFile(L"temp.yxdb");
 		ReadSampleFile(L"temp.yxdb");
+
+		TestRecordBlockIndex();
+		TestMemoryMapped();
+		TestReadAhead();
+		TestBlockWrites();
+		TestPreallocateAndHints();
+		TestUncompressed();
+		TestStreamRead();
+		TestStreamWrite();
+		TestMemoryFiles();
+		TestSkipIncompressible();
+		TestBlockSizes();
+		TestBlockDirectoryReads();
+		TestZeroCopy();
+		TestProjection();
+		TestColumns();
+		TestDirectIO();
+		TestCompressionThreads();
+		TestDecompressionThreads();
+		TestReadRecords();
+		TestBlockDirectory();
+		TestBlockCodecs();
+		TestLZ4ShortBlocks();
+		TestLZFLevels();
+		TestWideDecompress();
+		TestChecksums();
+		TestParallelScan(L"temp.yxdb");
+		std::cout << "All tests passed\n";
 	}
 	catch (SRC::Error e)
 	{
 		std::cout << SRC::ConvertToAString(e.GetErrorDescription()) << "\n";
+		return 1;
 	}
 	return 0;
 }
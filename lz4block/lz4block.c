@@ -0,0 +1,416 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// (C) 2008 SRC, LLC  -   All rights reserved
+//
+///////////////////////////////////////////////////////////////////////////////
+//
+// Module: LZ4BLOCK.C
+//
+// Each sequence is a token byte (4 bits of literal length, 4 bits of match
+// length - 4), more length bytes when either is 15, the literals, a 2 byte
+// little endian offset and more match length bytes.  The last sequence is just
+// literals: the last 5 bytes are always literals, and no match starts in the
+// last 12 bytes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include "lz4block.h"
+
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef unsigned int u32;
+
+#define MINMATCH 4
+#define LASTLITERALS 5
+#define MFLIMIT 12
+#define MAX_DISTANCE 0xffff
+
+/* the fast compressor's hash table is on the stack, like lzf's */
+#define FAST_HLOG 14
+/* the hash chains are 256K together - the same as lzf's LZF_STATE */
+#define HC_HLOG 15
+#define HC_CHAIN (MAX_DISTANCE+1)
+
+static u32
+read32 (const u8 *p)
+{
+  u32 v;
+  memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static u32
+hash32 (u32 v, int hlog)
+{
+  return (v * 2654435761U) >> (32 - hlog);
+}
+
+/* how many bytes match, up to limit */
+static unsigned int
+match_length (const u8 *ip, const u8 *ref, const u8 *limit)
+{
+  const u8 *start = ip;
+
+  while (ip + sizeof (u32) <= limit && read32 (ip) == read32 (ref))
+    {
+      ip += sizeof (u32);
+      ref += sizeof (u32);
+    }
+  while (ip < limit && *ip == *ref)
+    {
+      ip++;
+      ref++;
+    }
+
+  return (unsigned int)(ip - start);
+}
+
+static u8 *
+put_length (u8 *op, unsigned int len)
+{
+  while (len >= 255)
+    {
+      *op++ = 255;
+      len -= 255;
+    }
+  *op++ = (u8)len;
+  return op;
+}
+
+/* writes the literals from anchor to ip and a match.  NULL if it doesn't fit before oend */
+static u8 *
+put_sequence (u8 *op, u8 *oend, const u8 *anchor, const u8 *ip, unsigned int offset, unsigned int len)
+{
+  unsigned int lit = (unsigned int)(ip - anchor);
+  unsigned int ml = len - MINMATCH;
+  u8 *token;
+
+  if ((size_t)(oend - op) < 1 + lit / 255 + 1 + lit + 2 + ml / 255 + 1)
+    return 0;
+
+  token = op++;
+  if (lit >= 15)
+    {
+      *token = 15 << 4;
+      op = put_length (op, lit - 15);
+    }
+  else
+    *token = (u8)(lit << 4);
+
+  memcpy (op, anchor, lit);
+  op += lit;
+
+  op[0] = (u8)offset;
+  op[1] = (u8)(offset >> 8);
+  op += 2;
+
+  if (ml >= 15)
+    {
+      *token |= 15;
+      op = put_length (op, ml - 15);
+    }
+  else
+    *token |= (u8)ml;
+
+  return op;
+}
+
+/* the last sequence - only literals.  NULL if it doesn't fit */
+static u8 *
+put_last_literals (u8 *op, u8 *oend, const u8 *anchor, const u8 *iend)
+{
+  unsigned int lit = (unsigned int)(iend - anchor);
+
+  if ((size_t)(oend - op) < 1 + lit / 255 + 1 + lit)
+    return 0;
+
+  if (lit >= 15)
+    {
+      *op++ = 15 << 4;
+      op = put_length (op, lit - 15);
+    }
+  else
+    *op++ = (u8)(lit << 4);
+
+  memcpy (op, anchor, lit);
+  return op + lit;
+}
+
+static unsigned int
+compress_fast (const u8 *in, unsigned int in_len, u8 *out, unsigned int out_len)
+{
+  u32 htab[1 << FAST_HLOG];
+  const u8 *ip = in;
+  const u8 *anchor = in;
+  const u8 *const iend = in + in_len;
+  u8 *op = out;
+  u8 *const oend = out + out_len;
+
+  /* the limits would point before in for anything shorter */
+  if (in_len > MFLIMIT)
+    {
+      const u8 *const mflimit = iend - MFLIMIT;
+      const u8 *const matchlimit = iend - LASTLITERALS;
+
+      memset (htab, 0, sizeof (htab));
+
+      while (ip < mflimit)
+        {
+          u32 seq = read32 (ip);
+          u32 *slot = htab + hash32 (seq, FAST_HLOG);
+          const u8 *ref = in + *slot;
+
+          *slot = (u32)(ip - in);
+
+          if (ref < ip && ip - ref <= MAX_DISTANCE && read32 (ref) == seq)
+            {
+              unsigned int len;
+
+              while (ip > anchor && ref > in && ip[-1] == ref[-1])
+                {
+                  ip--;
+                  ref--;
+                }
+
+              len = MINMATCH + match_length (ip + MINMATCH, ref + MINMATCH, matchlimit);
+              op = put_sequence (op, oend, anchor, ip, (unsigned int)(ip - ref), len);
+              if (!op)
+                return 0;
+
+              ip += len;
+              anchor = ip;
+
+              /* so the next match can start right where this one ended */
+              if (ip < mflimit)
+                htab[hash32 (read32 (ip - 2), FAST_HLOG)] = (u32)(ip - 2 - in);
+            }
+          else
+            /* step faster through data that isn't matching */
+            ip += 1 + ((ip - anchor) >> 6);
+        }
+    }
+
+  op = put_last_literals (op, oend, anchor, iend);
+  return op ? (unsigned int)(op - out) : 0;
+}
+
+struct hc_state
+{
+  u32 head[1 << HC_HLOG];
+  u16 chain[HC_CHAIN];
+  u32 next;
+};
+
+/* adds every position up to ip to the hash chains */
+static void
+hc_insert (struct hc_state *hc, const u8 *in, const u8 *ip)
+{
+  u32 target = (u32)(ip - in);
+
+  while (hc->next < target)
+    {
+      u32 *slot = hc->head + hash32 (read32 (in + hc->next), HC_HLOG);
+      u32 delta = hc->next - *slot;
+
+      hc->chain[hc->next & (HC_CHAIN - 1)] = (u16)(delta > MAX_DISTANCE ? MAX_DISTANCE : delta);
+      *slot = hc->next;
+      hc->next++;
+    }
+}
+
+/* the longest match for ip within attempts positions of its hash chain.  0 if there isn't one */
+static unsigned int
+hc_find (struct hc_state *hc, const u8 *in, const u8 *ip, const u8 *matchlimit, int attempts, const u8 **r_ref)
+{
+  u32 cur = (u32)(ip - in);
+  u32 pos;
+  u32 seq = read32 (ip);
+  unsigned int best = 0;
+
+  hc_insert (hc, in, ip);
+  pos = hc->head[hash32 (seq, HC_HLOG)];
+
+  while (attempts-- > 0 && pos < cur && cur - pos <= MAX_DISTANCE)
+    {
+      const u8 *ref = in + pos;
+      u32 delta;
+
+      if (ref[best] == ip[best] && read32 (ref) == seq)
+        {
+          unsigned int len = MINMATCH + match_length (ip + MINMATCH, ref + MINMATCH, matchlimit);
+          if (len > best)
+            {
+              best = len;
+              *r_ref = ref;
+              if (ip + len >= matchlimit)
+                break;
+            }
+        }
+
+      delta = hc->chain[pos & (HC_CHAIN - 1)];
+      if (delta == 0 || delta > pos)
+        break;
+      pos -= delta;
+    }
+
+  return best;
+}
+
+static unsigned int
+compress_hc (const u8 *in, unsigned int in_len, u8 *out, unsigned int out_len, int level)
+{
+  struct hc_state hc;
+  int attempts = 1 << level;
+  const u8 *ip = in;
+  const u8 *anchor = in;
+  const u8 *const iend = in + in_len;
+  u8 *op = out;
+  u8 *const oend = out + out_len;
+
+  if (in_len > MFLIMIT)
+    {
+      const u8 *const mflimit = iend - MFLIMIT;
+      const u8 *const matchlimit = iend - LASTLITERALS;
+
+      memset (hc.head, 0, sizeof (hc.head));
+      hc.next = 0;
+
+      while (ip < mflimit)
+        {
+          const u8 *ref = 0;
+          unsigned int len = hc_find (&hc, in, ip, matchlimit, attempts, &ref);
+
+          if (len < MINMATCH)
+            {
+              ip++;
+              continue;
+            }
+
+          /* lazy matching: take a literal if the match starting at the next byte is longer */
+          while (ip + 1 < mflimit)
+            {
+              const u8 *ref2 = 0;
+              unsigned int len2 = hc_find (&hc, in, ip + 1, matchlimit, attempts, &ref2);
+              if (len2 <= len)
+                break;
+              ip++;
+              len = len2;
+              ref = ref2;
+            }
+
+          op = put_sequence (op, oend, anchor, ip, (unsigned int)(ip - ref), len);
+          if (!op)
+            return 0;
+
+          ip += len;
+          anchor = ip;
+        }
+    }
+
+  op = put_last_literals (op, oend, anchor, iend);
+  return op ? (unsigned int)(op - out) : 0;
+}
+
+unsigned int
+lz4block_compress (const void *const in_data, unsigned int in_len,
+                   void             *out_data, unsigned int out_len,
+                   int level)
+{
+  if (in_len == 0)
+    return 0;
+
+  if (level <= 0)
+    return compress_fast ((const u8 *)in_data, in_len, (u8 *)out_data, out_len);
+
+  if (level > LZ4BLOCK_MAX_LEVEL)
+    level = LZ4BLOCK_MAX_LEVEL;
+  return compress_hc ((const u8 *)in_data, in_len, (u8 *)out_data, out_len, level);
+}
+
+/* reads the extra length bytes after a 15 in the token.  0 if it runs off the end */
+static const u8 *
+get_length (const u8 *ip, const u8 *iend, unsigned int *len)
+{
+  unsigned int s;
+
+  do
+    {
+      if (ip >= iend)
+        return 0;
+      s = *ip++;
+      *len += s;
+    }
+  while (s == 255);
+
+  return ip;
+}
+
+unsigned int
+lz4block_decompress (const void *const in_data, unsigned int in_len,
+                     void             *out_data, unsigned int out_len)
+{
+  const u8 *ip = (const u8 *)in_data;
+  const u8 *const iend = ip + in_len;
+  u8 *op = (u8 *)out_data;
+  u8 *const out = op;
+  u8 *const oend = op + out_len;
+
+  if (in_len == 0)
+    return 0;
+
+  for (;;)
+    {
+      unsigned int token = *ip++;
+      unsigned int lit = token >> 4;
+      unsigned int ml = token & 15;
+      unsigned int offset;
+      const u8 *ref;
+
+      if (lit == 15 && !(ip = get_length (ip, iend, &lit)))
+        return 0;
+      if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op))
+        return 0;
+
+      memcpy (op, ip, lit);
+      op += lit;
+      ip += lit;
+
+      /* the last sequence has no match */
+      if (ip == iend)
+        break;
+
+      if (iend - ip < 2)
+        return 0;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > (size_t)(op - out))
+        return 0;
+
+      if (ml == 15 && !(ip = get_length (ip, iend, &ml)))
+        return 0;
+      ml += MINMATCH;
+      if (ml > (size_t)(oend - op))
+        return 0;
+
+      /* the match can overlap what it is writing - 8 bytes at a time is only safe 8 or more back */
+      ref = op - offset;
+      if (offset >= 8)
+        {
+          while (ml >= 8)
+            {
+              memcpy (op, ref, 8);
+              op += 8;
+              ref += 8;
+              ml -= 8;
+            }
+        }
+      while (ml--)
+        *op++ = *ref++;
+
+      if (ip >= iend)
+        return 0;
+    }
+
+  return (unsigned int)(op - out);
+}
@@ -0,0 +1,46 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// (C) 2008 SRC, LLC  -   All rights reserved
+//
+///////////////////////////////////////////////////////////////////////////////
+//
+// Module: LZ4BLOCK.H
+//
+// A self contained codec for the LZ4 block format - the format only, without
+// the LZ4 frame format around it.  It has the same calling convention as
+// lzf_compress/lzf_decompress, so it can be used the same way for a block.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef LZ4BLOCK_H
+#define LZ4BLOCK_H
+
+/*
+ * the highest level lz4block_compress takes.
+ * 0 is the fast greedy compressor, 1 to LZ4BLOCK_MAX_LEVEL search hash chains
+ * (more of them at each level) for longer matches.  The output is the same
+ * format either way, so it doesn't affect how fast it decompresses.
+ */
+#define LZ4BLOCK_MAX_LEVEL 9
+
+/*
+ * Compress in_len bytes at in_data into out_data, up to out_len bytes.
+ * Returns 0 if it doesn't fit (so use out_len == in_len - 1 to only keep
+ * data that actually compressed), otherwise the number of bytes used.
+ * Matches only go back 64K, so in_len can be any size.
+ */
+unsigned int
+lz4block_compress (const void *const in_data, unsigned int in_len,
+                   void             *out_data, unsigned int out_len,
+                   int level);
+
+/*
+ * Decompress in_len bytes at in_data into out_data, up to out_len bytes.
+ * Returns the number of bytes decompressed, or 0 if the data is corrupt or
+ * doesn't fit.  It never reads or writes outside of the 2 buffers.
+ */
+unsigned int
+lz4block_decompress (const void *const in_data, unsigned int in_len,
+                     void             *out_data, unsigned int out_len);
+
+#endif
@@ -0,0 +1,20 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// (C) 2008 SRC, LLC  -   All rights reserved
+//
+///////////////////////////////////////////////////////////////////////////////
+//
+// Module: LZF_C_FAST.C
+//
+// lzf_compress built for speed, as lzf_compress_fast - see LZF_Fast in lzf_src.h.
+// A smaller hash table and the cheapest hash, which liblzf suggests for binary
+// data.  The output is still plain LZF.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define HLOG 14
+#define VERY_FAST 1
+#define ULTRA_FAST 1
+
+#define lzf_compress lzf_compress_fast
+#include "lzf_c.c"
@@ -0,0 +1,188 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// (C) 2008 SRC, LLC  -   All rights reserved
+//
+///////////////////////////////////////////////////////////////////////////////
+//
+// Module: LZF_C_HC.C
+//
+// lzf_compress_hc - see LZF_Better and LZF_Best in lzf_src.h.  lzf_compress only
+// looks at the last position with the same hash, and takes the first match it
+// finds.  This searches a hash chain of the 8K window for the longest match, and
+// takes a literal instead when the match at the next byte is longer.  It is a few
+// times slower, and the output is plain LZF for the unchanged lzf_decompress.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef unsigned int u32;
+
+/* the limits of the LZF format - the same as lzf_c.c */
+#define MAX_LIT (1 << 5)
+#define MAX_OFF (1 << 13)
+#define MAX_REF ((1 << 8) + (1 << 3))
+#define MIN_REF 3
+
+/* the hash chains are 144K, so they are fine on the stack like lzf_compress's table */
+#define HLOG 15
+
+struct lzf_hc
+{
+  u32 head[1 << HLOG];
+  /* how far back the previous position with the same hash is, 0 for none */
+  u16 chain[MAX_OFF];
+  u32 next;
+};
+
+static u32
+hash3 (const u8 *p)
+{
+  u32 v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761U) >> (32 - HLOG);
+}
+
+/* the longest match for ip, up to maxlen, in the first attempts positions of its chain.
+   0 if there isn't one of at least MIN_REF */
+static unsigned int
+find_match (struct lzf_hc *hc, const u8 *in, const u8 *ip, unsigned int maxlen, int attempts, const u8 **r_ref)
+{
+  u32 cur = (u32)(ip - in);
+  u32 pos;
+  unsigned int best = 0;
+
+  /* add every position before ip to the chains */
+  while (hc->next < cur)
+    {
+      u32 *slot = hc->head + hash3 (in + hc->next);
+      u32 delta = hc->next - *slot;
+
+      hc->chain[hc->next & (MAX_OFF - 1)] = (u16)(delta < MAX_OFF ? delta : 0);
+      *slot = hc->next;
+      hc->next++;
+    }
+
+  pos = hc->head[hash3 (ip)];
+  while (attempts-- > 0 && pos < cur && cur - pos - 1 < MAX_OFF)
+    {
+      const u8 *ref = in + pos;
+      u32 delta;
+
+      if (ref[best] == ip[best] && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2])
+        {
+          unsigned int len = MIN_REF;
+          while (len < maxlen && ref[len] == ip[len])
+            len++;
+
+          if (len > best)
+            {
+              best = len;
+              *r_ref = ref;
+              if (len == maxlen)
+                break;
+            }
+        }
+
+      delta = hc->chain[pos & (MAX_OFF - 1)];
+      if (delta == 0 || delta > pos)
+        break;
+      pos -= delta;
+    }
+
+  return best >= MIN_REF ? best : 0;
+}
+
+static unsigned int
+max_length (const u8 *ip, const u8 *in_end)
+{
+  return in_end - ip < MAX_REF ? (unsigned int)(in_end - ip) : MAX_REF;
+}
+
+unsigned int
+lzf_compress_hc (const void *const in_data, unsigned int in_len,
+                 void *out_data, unsigned int out_len,
+                 int max_attempts)
+{
+  struct lzf_hc hc;
+  const u8 *const in = (const u8 *)in_data;
+  const u8 *ip = in;
+  const u8 *const in_end = ip + in_len;
+  u8 *op = (u8 *)out_data;
+  u8 *const out_end = op + out_len;
+  int lit = 0;
+
+  if (!in_len || !out_len)
+    return 0;
+
+  memset (hc.head, 0, sizeof (hc.head));
+  hc.next = 0;
+
+  op++; /* start run */
+
+  while (ip < in_end)
+    {
+      const u8 *ref = 0;
+      unsigned int len = in_end - ip >= MIN_REF ? find_match (&hc, in, ip, max_length (ip, in_end), max_attempts, &ref) : 0;
+
+      if (len)
+        {
+          /* a longer match 1 byte later is worth the literal */
+          if (ip + 1 + MIN_REF <= in_end)
+            {
+              const u8 *ref2 = 0;
+              unsigned int len2 = find_match (&hc, in, ip + 1, max_length (ip + 1, in_end), max_attempts, &ref2);
+              if (len2 > len)
+                len = 0;
+            }
+        }
+
+      if (len)
+        {
+          unsigned int off = (unsigned int)(ip - ref - 1);
+          unsigned int l = len - 2;
+
+          /* the match and the start of the next run */
+          if (op + 3 + 1 >= out_end)
+            return 0;
+
+          op[- lit - 1] = lit - 1; /* stop run */
+          op -= !lit; /* undo run if length is zero */
+
+          if (l < 7)
+            *op++ = (off >> 8) + (l << 5);
+          else
+            {
+              *op++ = (off >> 8) + (  7 << 5);
+              *op++ = l - 7;
+            }
+          *op++ = off;
+
+          lit = 0; op++; /* start run */
+          ip += len;
+        }
+      else
+        {
+          /* one more literal byte we must copy */
+          if (op >= out_end)
+            return 0;
+
+          lit++; *op++ = *ip++;
+
+          if (lit == MAX_LIT)
+            {
+              op[- lit - 1] = lit - 1; /* stop run */
+              lit = 0; op++; /* start run */
+            }
+        }
+    }
+
+  if (op > out_end)
+    return 0;
+
+  op[- lit - 1] = lit - 1; /* end run */
+  op -= !lit; /* undo run if length is zero */
+
+  return (unsigned int)(op - (u8 *)out_data);
+}
@@ -0,0 +1,205 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// (C) 2008 SRC, LLC  -   All rights reserved
+//
+///////////////////////////////////////////////////////////////////////////////
+//
+// Module: LZF_CRC32C.C
+//
+// CRC32C (Castagnoli) for the block checksums.  lzf_crc32c_select picks the
+// CRC instructions this CPU has: SSE4.2 on x86, the ARMv8 CRC extension on
+// ARM, and otherwise a table driven version that does 8 bytes at a time.
+// They all give the same answer.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#if defined (__x86_64__) || defined (__i386__) || defined (_M_X64) || defined (_M_IX86)
+# define LZF_CRC_X86 1
+# include <nmmintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif
+#elif defined (__aarch64__) || defined (_M_ARM64)
+# define LZF_CRC_ARM 1
+# include <arm_acle.h>
+# if defined (__linux__)
+#  include <sys/auxv.h>
+# endif
+#endif
+
+typedef unsigned char u8;
+typedef unsigned int u32;
+
+typedef unsigned int (*lzf_crc32c_fn) (unsigned int crc, const void *data, unsigned int len);
+
+/* the reflected Castagnoli polynomial */
+#define CRC32C_POLY 0x82f63b78
+
+/* crc_tab[k][b] is the crc of byte b followed by k zero bytes */
+static u32 crc_tab[8][256];
+
+static void
+crc32c_init_table (void)
+{
+  unsigned int b, k;
+
+  for (b = 0; b < 256; b++)
+    {
+      u32 crc = b;
+      for (k = 0; k < 8; k++)
+        crc = (crc >> 1) ^ (CRC32C_POLY & (0 - (crc & 1)));
+      crc_tab[0][b] = crc;
+    }
+
+  for (b = 0; b < 256; b++)
+    for (k = 1; k < 8; k++)
+      crc_tab[k][b] = (crc_tab[k - 1][b] >> 8) ^ crc_tab[0][crc_tab[k - 1][b] & 0xff];
+}
+
+static unsigned int
+lzf_crc32c_sw (unsigned int crc, const void *data, unsigned int len)
+{
+  const u8 *p = (const u8 *)data;
+
+  crc = ~crc;
+
+  while (len >= 8)
+    {
+      u32 lo, hi;
+
+      /* the table is for little endian order, which is what the file is in anyway */
+      lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24));
+      hi = p[4] | (p[5] << 8) | (p[6] << 16) | ((u32)p[7] << 24);
+      crc = crc_tab[7][lo & 0xff] ^ crc_tab[6][(lo >> 8) & 0xff]
+          ^ crc_tab[5][(lo >> 16) & 0xff] ^ crc_tab[4][lo >> 24]
+          ^ crc_tab[3][hi & 0xff] ^ crc_tab[2][(hi >> 8) & 0xff]
+          ^ crc_tab[1][(hi >> 16) & 0xff] ^ crc_tab[0][hi >> 24];
+      p += 8;
+      len -= 8;
+    }
+
+  while (len--)
+    crc = (crc >> 8) ^ crc_tab[0][(crc ^ *p++) & 0xff];
+
+  return ~crc;
+}
+
+#if LZF_CRC_X86
+
+/* gcc only lets a function use the instructions it is compiled for */
+# if defined (__GNUC__)
+#  define LZF_TARGET(t) __attribute__ ((target (t)))
+# else
+#  define LZF_TARGET(t)
+# endif
+
+static unsigned int LZF_TARGET ("sse4.2")
+lzf_crc32c_sse42 (unsigned int crc, const void *data, unsigned int len)
+{
+  const u8 *p = (const u8 *)data;
+
+  crc = ~crc;
+
+# if defined (__x86_64__) || defined (_M_X64)
+  {
+    unsigned long long crc64 = crc;
+    while (len >= 8)
+      {
+        unsigned long long v;
+        memcpy (&v, p, sizeof (v));
+        crc64 = _mm_crc32_u64 (crc64, v);
+        p += 8;
+        len -= 8;
+      }
+    crc = (unsigned int)crc64;
+  }
+# endif
+  while (len >= 4)
+    {
+      unsigned int v;
+      memcpy (&v, p, sizeof (v));
+      crc = _mm_crc32_u32 (crc, v);
+      p += 4;
+      len -= 4;
+    }
+  while (len--)
+    crc = _mm_crc32_u8 (crc, *p++);
+
+  return ~crc;
+}
+
+static int
+lzf_has_sse42 (void)
+{
+  unsigned int regs[4];
+
+# ifdef _MSC_VER
+  __cpuid ((int *)regs, 1);
+# else
+  __asm__ __volatile__ ("cpuid" : "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3]) : "a" (1), "c" (0));
+# endif
+  return (regs[2] & (1 << 20)) != 0;
+}
+
+#elif LZF_CRC_ARM
+
+# if defined (__GNUC__)
+#  define LZF_TARGET_CRC __attribute__ ((target ("+crc")))
+# else
+#  define LZF_TARGET_CRC
+# endif
+
+static unsigned int LZF_TARGET_CRC
+lzf_crc32c_arm (unsigned int crc, const void *data, unsigned int len)
+{
+  const u8 *p = (const u8 *)data;
+
+  crc = ~crc;
+
+  while (len >= 8)
+    {
+      unsigned long long v;
+      memcpy (&v, p, sizeof (v));
+      crc = __crc32cd (crc, v);
+      p += 8;
+      len -= 8;
+    }
+  while (len--)
+    crc = __crc32cb (crc, *p++);
+
+  return ~crc;
+}
+
+static int
+lzf_has_arm_crc (void)
+{
+# if defined (__linux__)
+#  ifndef HWCAP_CRC32
+#   define HWCAP_CRC32 (1 << 7)
+#  endif
+  return (getauxval (AT_HWCAP) & HWCAP_CRC32) != 0;
+# elif defined (_M_ARM64) || defined (__APPLE__)
+  /* every 64 bit ARM that Windows or macOS runs on has it */
+  return 1;
+# else
+  return 0;
+# endif
+}
+
+#endif
+
+lzf_crc32c_fn
+lzf_crc32c_select (void)
+{
+#if LZF_CRC_X86
+  if (lzf_has_sse42 ())
+    return lzf_crc32c_sse42;
+#elif LZF_CRC_ARM
+  if (lzf_has_arm_crc ())
+    return lzf_crc32c_arm;
+#endif
+  crc32c_init_table ();
+  return lzf_crc32c_sw;
+}
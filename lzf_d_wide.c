@@ -0,0 +1,149 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// (C) 2008 SRC, LLC  -   All rights reserved
+//
+///////////////////////////////////////////////////////////////////////////////
+//
+// Module: LZF_D_WIDE.C
+//
+// lzf_decompress, copying literal runs and back references a whole chunk at a
+// time instead of a byte at a time.  The output is exactly what lzf_decompress
+// gives, and it fails on the same corrupt input.  lzf_decompress_select picks the
+// widest copy this CPU can do: AVX2 or SSE2 on x86, NEON on ARM, 8 bytes otherwise.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#if defined (__x86_64__) || defined (__i386__) || defined (_M_X64) || defined (_M_IX86)
+# define LZF_WIDE_X86 1
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif
+#elif defined (__ARM_NEON) || defined (_M_ARM64)
+# define LZF_WIDE_NEON 1
+# include <arm_neon.h>
+#endif
+
+typedef unsigned char u8;
+
+/* the limits of the LZF format */
+#define MAX_LIT (1 << 5)
+#define MAX_REF ((1 << 8) + (1 << 3))
+
+typedef unsigned int (*lzf_decompress_fn) (const void *const in_data, unsigned int in_len,
+                                           void *out_data, unsigned int out_len);
+
+#define LZF_WIDE_FN lzf_decompress_8
+#define LZF_WIDE 8
+#define LZF_WIDE_COPY(d, s) memcpy ((d), (s), 8)
+#define LZF_WIDE_ATTR
+#include "lzf_d_wide.inc"
+#undef LZF_WIDE_FN
+#undef LZF_WIDE
+#undef LZF_WIDE_COPY
+#undef LZF_WIDE_ATTR
+
+#if LZF_WIDE_X86
+
+/* gcc only lets a function use the instructions it is compiled for */
+# if defined (__GNUC__)
+#  define LZF_TARGET(t) __attribute__ ((target (t)))
+# else
+#  define LZF_TARGET(t)
+# endif
+
+# define LZF_WIDE_FN lzf_decompress_sse2
+# define LZF_WIDE 16
+# define LZF_WIDE_COPY(d, s) _mm_storeu_si128 ((__m128i *)(d), _mm_loadu_si128 ((const __m128i *)(s)))
+# define LZF_WIDE_ATTR LZF_TARGET ("sse2")
+# include "lzf_d_wide.inc"
+# undef LZF_WIDE_FN
+# undef LZF_WIDE
+# undef LZF_WIDE_COPY
+# undef LZF_WIDE_ATTR
+
+# define LZF_WIDE_FN lzf_decompress_avx2
+# define LZF_WIDE 32
+# define LZF_WIDE_COPY(d, s) _mm256_storeu_si256 ((__m256i *)(d), _mm256_loadu_si256 ((const __m256i *)(s)))
+# define LZF_WIDE_ATTR LZF_TARGET ("avx2")
+# include "lzf_d_wide.inc"
+# undef LZF_WIDE_FN
+# undef LZF_WIDE
+# undef LZF_WIDE_COPY
+# undef LZF_WIDE_ATTR
+
+static void
+lzf_cpuid (int leaf, unsigned int regs[4])
+{
+# ifdef _MSC_VER
+  __cpuidex ((int *)regs, leaf, 0);
+# else
+  __asm__ __volatile__ ("cpuid" : "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3]) : "a" (leaf), "c" (0));
+# endif
+}
+
+/* AVX2 needs the CPU to have it, and the OS to save the YMM registers */
+static int
+lzf_has_avx2 (void)
+{
+  unsigned int regs[4];
+  unsigned int xcr0_lo;
+
+  lzf_cpuid (0, regs);
+  if (regs[0] < 7)
+    return 0;
+
+  lzf_cpuid (1, regs);
+  if (!(regs[2] & (1 << 27)) || !(regs[2] & (1 << 28))) /* OSXSAVE, AVX */
+    return 0;
+
+# ifdef _MSC_VER
+  xcr0_lo = (unsigned int)_xgetbv (0);
+# else
+  __asm__ __volatile__ ("xgetbv" : "=a" (xcr0_lo) : "c" (0) : "edx");
+# endif
+  if ((xcr0_lo & 6) != 6) /* XMM and YMM state */
+    return 0;
+
+  lzf_cpuid (7, regs);
+  return (regs[1] & (1 << 5)) != 0;
+}
+
+static int
+lzf_has_sse2 (void)
+{
+  unsigned int regs[4];
+
+  lzf_cpuid (1, regs);
+  return (regs[3] & (1 << 26)) != 0;
+}
+
+#elif LZF_WIDE_NEON
+
+# define LZF_WIDE_FN lzf_decompress_neon
+# define LZF_WIDE 16
+# define LZF_WIDE_COPY(d, s) vst1q_u8 ((d), vld1q_u8 (s))
+# define LZF_WIDE_ATTR
+# include "lzf_d_wide.inc"
+# undef LZF_WIDE_FN
+# undef LZF_WIDE
+# undef LZF_WIDE_COPY
+# undef LZF_WIDE_ATTR
+
+#endif
+
+lzf_decompress_fn
+lzf_decompress_select (void)
+{
+#if LZF_WIDE_X86
+  if (lzf_has_avx2 ())
+    return lzf_decompress_avx2;
+  if (lzf_has_sse2 ())
+    return lzf_decompress_sse2;
+#elif LZF_WIDE_NEON
+  return lzf_decompress_neon;
+#endif
+  return lzf_decompress_8;
+}
@@ -15,28 +15,344 @@
 extern "C"
 {
 	#include "lzf.h"
+	#include "lz4block.h"
+
+	// other ways of making lzf_compress output, for the BC_LZF levels - see lzf_c_fast.c and lzf_c_hc.c
+	unsigned int lzf_compress_fast (const void *const in_data, unsigned int in_len, void *out_data, unsigned int out_len);
+	unsigned int lzf_compress_hc (const void *const in_data, unsigned int in_len, void *out_data, unsigned int out_len, int max_attempts);
+
+	// lzf_decompress with the widest copies this CPU can do - see lzf_d_wide.c
+	typedef unsigned int (*lzf_decompress_fn) (const void *const in_data, unsigned int in_len, void *out_data, unsigned int out_len);
+	lzf_decompress_fn lzf_decompress_select (void);
+
+	// CRC32C with the CRC instructions this CPU has - see lzf_crc32c.c
+	typedef unsigned int (*lzf_crc32c_fn) (unsigned int crc, const void *data, unsigned int len);
+	lzf_crc32c_fn lzf_crc32c_select (void);
 }
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
 
 namespace SRC
 {
+	// what the blocks are compressed with.  The values are what is stored in HeaderData::nCompressionVersion
+	// (0 is not compressed at all), so new codecs can only be added on the end
+	enum E_BlockCodec
+	{
+		BC_LZF = 1,
+		BC_LZ4 = 2,		// lz4block - decompresses faster than LZF.  With a level above 0 it also compresses smaller
+
+		BC_Max = BC_LZ4
+	};
+
+	// the levels for BC_LZF.  They all write plain LZF, so the level doesn't matter to a reader
+	enum E_LZFLevel
+	{
+		LZF_Fast = -1,		// ~10% faster and a little bigger.  For scratch files that are read once
+		LZF_Default = 0,	// lzf_compress as it has always been built
+		LZF_Better = 1,		// ~15% smaller, and several times slower
+		LZF_Best = 2,		// ~20% smaller, and slower again.  For files that are written once and read a lot
+	};
+
+	// a codec and the level to compress with.  LZFBufferedOutput and LZFBufferedInput only frame the blocks,
+	// this is what goes in them
+	struct BlockCodec
+	{
+		E_BlockCodec m_codec;
+		int m_nLevel;
+
+		inline BlockCodec(E_BlockCodec codec = BC_LZF, int nLevel = 0)
+			: m_codec(codec), m_nLevel(nLevel)
+		{
+		}
+
+		// returns 0 if it doesn't fit in nOutSize
+		inline unsigned Compress(const void *pIn, unsigned nInSize, void *pOut, unsigned nOutSize) const
+		{
+			switch (m_codec)
+			{
+			case BC_LZ4:
+				return lz4block_compress(pIn, nInSize, pOut, nOutSize, m_nLevel);
+			case BC_LZF:
+			default:
+				if (m_nLevel<=LZF_Fast)
+					return lzf_compress_fast(pIn, nInSize, pOut, nOutSize);
+				if (m_nLevel==LZF_Default)
+					return lzf_compress(pIn, nInSize, pOut, nOutSize);
+				// how much of the hash chains to search
+				return lzf_compress_hc(pIn, nInSize, pOut, nOutSize, m_nLevel==LZF_Better ? 8 : 64);
+			}
+		}
+
+		// returns 0 if the block is corrupt or doesn't fit in nOutSize
+		inline unsigned Decompress(const void *pIn, unsigned nInSize, void *pOut, unsigned nOutSize) const
+		{
+			switch (m_codec)
+			{
+			case BC_LZ4:
+				return lz4block_decompress(pIn, nInSize, pOut, nOutSize);
+			case BC_LZF:
+			default:
+				{
+					static const lzf_decompress_fn pfnDecompress = lzf_decompress_select();
+					return pfnDecompress(pIn, nInSize, pOut, nOutSize);
+				}
+			}
+		}
+	};
+
+	////////////////////////////////////////////////////////////////////////////////
+	// class LZFThreads
+	// a pool of std::threads for LZFBufferedOutput and LZFBufferedInput to (de)compress blocks on.
+	// TJob needs a DoWork(), and a bool m_bDone that is only touched under the pool's lock.
+	// Whoever queues the jobs waits for them, in whatever order they need them
+	template <class TJob> class LZFThreads
+	{
+		std::mutex m_mutex;
+		std::condition_variable m_cvQueued;
+		std::condition_variable m_cvDone;
+		std::deque<TJob *> m_queue;
+		std::vector<std::thread> m_vThreads;
+		bool m_bShutdown;
+
+		void Run()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			for (;;)
+			{
+				m_cvQueued.wait(lock, [this] { return m_bShutdown || !m_queue.empty(); });
+				if (m_queue.empty())
+					return;
+
+				TJob *pJob = m_queue.front();
+				m_queue.pop_front();
+
+				lock.unlock();
+				pJob->DoWork();
+				lock.lock();
+
+				pJob->m_bDone = true;
+				m_cvDone.notify_all();
+			}
+		}
+
+		void Shutdown()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_bShutdown = true;
+			}
+			m_cvQueued.notify_all();
+			for (size_t x=0; x<m_vThreads.size(); x++)
+				m_vThreads[x].join();
+			m_vThreads.clear();
+		}
+
+		LZFThreads(const LZFThreads &);
+		LZFThreads & operator =(const LZFThreads &);
+	public:
+		LZFThreads(unsigned nNumThreads)
+			: m_bShutdown(false)
+		{
+			try
+			{
+				for (unsigned x=0; x<nNumThreads; x++)
+					m_vThreads.push_back(std::thread(&LZFThreads::Run, this));
+			}
+			catch (...)
+			{
+				Shutdown();
+				throw Error("LZFThreads: Unable to start the worker threads.");
+			}
+		}
+		~LZFThreads()
+		{
+			Shutdown();
+		}
+
+		void Queue(TJob *pJob)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				pJob->m_bDone = false;
+				m_queue.push_back(pJob);
+			}
+			m_cvQueued.notify_one();
+		}
+
+		void WaitForCompletion(TJob *pJob)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cvDone.wait(lock, [pJob] { return pJob->m_bDone; });
+		}
+	};
+
+	// how much each block holds before it is compressed.  A file records it if it uses anything else - see FF_BlockSize
+	const unsigned LZFDefaultBlockSize = 0x40000;
+	const unsigned LZFMinBlockSize = 0x1000;
+	const unsigned LZFMaxBlockSize = 0x1000000;
+
+	////////////////////////////////////////////////////////////////////////////////
+	// class LZFBufferPool
+	// keeps the block buffers of LZFBufferedOutputs and LZFBufferedInputs that are done with them, for the
+	// next one to use instead of allocating its own.  Worth it when lots of files are opened one after another.
+	// Any number of them can share one, on any threads.  It holds on to at most nMaxBytes
+	class LZFBufferPool
+	{
+		std::mutex m_mutex;
+		std::vector<std::pair<size_t, unsigned char *> > m_vFree;
+		size_t m_nFreeBytes;
+		size_t m_nMaxBytes;
+
+		LZFBufferPool(const LZFBufferPool &);
+		LZFBufferPool & operator =(const LZFBufferPool &);
+	public:
+		inline LZFBufferPool(size_t nMaxBytes = 0x4000000)
+			: m_nFreeBytes(0), m_nMaxBytes(nMaxBytes)
+		{
+		}
+		inline ~LZFBufferPool()
+		{
+			for (size_t x=0; x<m_vFree.size(); x++)
+				delete [] m_vFree[x].second;
+		}
+
+		inline unsigned char * Get(size_t nSize)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for (size_t x=m_vFree.size(); x>0; x--)
+				{
+					if (m_vFree[x-1].first==nSize)
+					{
+						unsigned char *pRet = m_vFree[x-1].second;
+						m_vFree.erase(m_vFree.begin() + (x-1));
+						m_nFreeBytes -= nSize;
+						return pRet;
+					}
+				}
+			}
+			return new unsigned char[nSize];
+		}
+
+		inline void Release(unsigned char *pBuffer, size_t nSize)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_nFreeBytes+nSize<=m_nMaxBytes)
+				{
+					m_vFree.push_back(std::make_pair(nSize, pBuffer));
+					m_nFreeBytes += nSize;
+					return;
+				}
+			}
+			delete [] pBuffer;
+		}
+	};
+
+	// a block buffer - from the pool if there is one, otherwise just from the heap
+	class LZFBuffer
+	{
+		std::shared_ptr<LZFBufferPool> m_pPool;
+		size_t m_nSize;
+		unsigned char *m_pBuffer;
+
+		LZFBuffer(const LZFBuffer &);
+		LZFBuffer & operator =(const LZFBuffer &);
+	public:
+		inline LZFBuffer(size_t nSize, const std::shared_ptr<LZFBufferPool> &pPool)
+			: m_pPool(pPool), m_nSize(nSize)
+		{
+			m_pBuffer = m_pPool ? m_pPool->Get(nSize) : new unsigned char[nSize];
+		}
+		inline ~LZFBuffer()
+		{
+			if (m_pPool)
+				m_pPool->Release(m_pBuffer, m_nSize);
+			else
+				delete [] m_pBuffer;
+		}
+		inline unsigned char * Get() const { return m_pBuffer; }
+	};
+
+	inline unsigned LZFCheckBlockSize(unsigned nBlockSize)
+	{
+		if (nBlockSize<LZFMinBlockSize || nBlockSize>LZFMaxBlockSize)
+			throw Error("LZF: The block size must be between 4K and 16MB.");
+		return nBlockSize;
+	}
+
+	// the checksum written after a block's length when the blocks have them.  It covers the length too,
+	// so a block that claims to be uncompressed (or a different size) doesn't pass either
+	inline unsigned LZFBlockChecksum(unsigned nLength, const void *pData, unsigned nSize)
+	{
+		static const lzf_crc32c_fn pfnCrc = lzf_crc32c_select();
+		return pfnCrc(pfnCrc(0, &nLength, sizeof(nLength)), pData, nSize);
+	}
+
+	// one block in the block directory - see LZFBufferedOutput::SetBlockDirectory.
+	// The records aren't lined up with the blocks, so it says where the first one that starts in the block is
+	struct LZFBlockEntry
+	{
+		__int64 nPos;				// where the block (its length) starts in the file
+		__int64 nFirstRecord;		// the first record that starts in the block - or if none does, the next one that does
+		unsigned nSize;				// uncompressed
+		unsigned nFirstRecordOffset;	// where nFirstRecord starts in the uncompressed block.  nSize if no record starts in it
+	};
+
 	// TFileP is usually a SmartPointer to a file
-	template <class TFileP, class TEngine, unsigned BufferSize=0x40000> class LZFBufferedOutput : public SmartPointerRefObj_Base
+	template <class TFileP, class TEngine> class LZFBufferedOutput : public SmartPointerRefObj_Base
 	{
 		struct CompressBuffer
 		{
-			unsigned char m_pOutBuffer[BufferSize];
+			// each buffer has room for the block length and checksum in front of it
+			// so DoWrite can write them and the data with a single Write
+			enum { LengthSize = sizeof(unsigned), ChecksumSize = sizeof(unsigned), PrefixSize = LengthSize + ChecksumSize };
+			const unsigned m_nBlockSize;
+			LZFBuffer m_outBlock;
+			unsigned char * const m_pOutBuffer;
 			unsigned m_nOutBufferUsed;
-			unsigned char m_pInBuffer[BufferSize];
+			LZFBuffer m_inBlock;
+			unsigned char * const m_pInBuffer;
 			unsigned m_nInBufferUsed;
 
+			// only used by LZFThreads, under its lock
+			bool m_bDone;
+			// set before each compress - try LooksIncompressible first
+			bool m_bProbe;
+			// set before each compress - work out m_nChecksum
+			bool m_bChecksum;
+			unsigned m_nChecksum;
+			// the first and last records that start in this buffer, for the block directory.  -1 if none has
+			__int64 m_nFirstRecord;
+			unsigned m_nFirstRecordOffset;
+			__int64 m_nLastRecord;
+
 			TFileP m_pFile;
+			BlockCodec m_codec;
 #ifndef __GNUC__
 			HANDLE m_hEvent;
 #endif
-			inline CompressBuffer(TFileP pFile, bool bCreateEvent)
-				: m_nOutBufferUsed(0)
+			inline CompressBuffer(TFileP pFile, BlockCodec codec, unsigned nBlockSize, const std::shared_ptr<LZFBufferPool> &pPool, bool bCreateEvent)
+				: m_nBlockSize(nBlockSize)
+				, m_outBlock(PrefixSize + nBlockSize, pPool)
+				, m_pOutBuffer(m_outBlock.Get() + PrefixSize)
+				, m_nOutBufferUsed(0)
+				, m_inBlock(PrefixSize + nBlockSize, pPool)
+				, m_pInBuffer(m_inBlock.Get() + PrefixSize)
 				, m_nInBufferUsed(0)
+				, m_bDone(true)
+				, m_bProbe(false)
+				, m_bChecksum(false)
+				, m_nChecksum(0)
+				, m_nFirstRecord(-1)
+				, m_nFirstRecordOffset(0)
+				, m_nLastRecord(-1)
 				, m_pFile(pFile)
+				, m_codec(codec)
 			{
 #ifndef __GNUC__
 				if (bCreateEvent)
@@ -54,10 +370,44 @@ namespace SRC
 #endif
 			}
 
+			// compresses a few pieces from across the buffer.  If none of them gets ~3% smaller, the whole
+			// buffer almost certainly won't either - it is already compressed images, etc...
+			bool LooksIncompressible()
+			{
+				const unsigned SampleSize = 0x1000;
+				const unsigned NumSamples = 4;
+				if (m_nInBufferUsed<SampleSize*NumSamples*2)
+					return false;
+
+				for (unsigned x=0; x<NumSamples; x++)
+				{
+					const unsigned char *pSample = m_pInBuffer + (m_nInBufferUsed-SampleSize)/(NumSamples-1)*x;
+					if (m_codec.Compress(pSample, SampleSize, m_pOutBuffer, SampleSize - SampleSize/32)!=0)
+						return false;
+				}
+				return true;
+			}
+
 			void DoCompress()
 			{
 				assert(m_nInBufferUsed!=0);
-				m_nOutBufferUsed = lzf_compress(m_pInBuffer, m_nInBufferUsed, m_pOutBuffer, m_nInBufferUsed-1);
+				if (m_bProbe && LooksIncompressible())
+					m_nOutBufferUsed = 0;  // DoWrite will write it uncompressed
+				else
+					m_nOutBufferUsed = m_codec.Compress(m_pInBuffer, m_nInBufferUsed, m_pOutBuffer, m_nInBufferUsed-1);
+
+				// here rather than in DoWrite, so it is done on the compression threads
+				if (m_bChecksum)
+				{
+					if (m_nOutBufferUsed==0)
+						m_nChecksum = LZFBlockChecksum(m_nInBufferUsed | 0x80000000, m_pInBuffer, m_nInBufferUsed);
+					else
+						m_nChecksum = LZFBlockChecksum(m_nOutBufferUsed, m_pOutBuffer, m_nOutBufferUsed);
+				}
+			}
+			inline void DoWork()
+			{
+				DoCompress();
 			}
 
 			// this will be called in a worker thread
@@ -78,6 +428,22 @@ namespace SRC
 				WaitForSingleObject(m_hEvent, INFINITE);
 			}
 #endif
+			static inline void PutLength(unsigned char *pBlock, unsigned nResultBytes)
+			{
+				memcpy(pBlock, &nResultBytes, sizeof(nResultBytes));
+			}
+
+			// writes the length, the checksum if there is one, and then the data
+			inline void WriteBlock(unsigned char *pData, unsigned nLength, unsigned nSize)
+			{
+				unsigned nPrefix = m_bChecksum ? PrefixSize : LengthSize;
+				unsigned char *pBlock = pData - nPrefix;
+				PutLength(pBlock, nLength);
+				if (m_bChecksum)
+					memcpy(pBlock + LengthSize, &m_nChecksum, ChecksumSize);
+				m_pFile->Write((const char *)pBlock, nPrefix + nSize);
+			}
+
 			// this should always be called from the master thread
 			inline void DoWrite()
 			{
@@ -86,42 +452,57 @@ namespace SRC
 				// it wasn't able to compress, just write the data straight out
 				if (m_nOutBufferUsed==0)
 				{
-					assert(m_nInBufferUsed<=BufferSize);
-					unsigned nResultBytes = m_nInBufferUsed;
-					if (BufferSize<=0x7fff)
-					{
-						unsigned short snResultBytes = static_cast<unsigned short>(nResultBytes | 0x8000);
-						m_pFile->Write(&snResultBytes, sizeof(snResultBytes));
-					}
-					else
-					{
-						nResultBytes |= 0x80000000;
-						m_pFile->Write(&nResultBytes, sizeof(nResultBytes));
-					}
-					m_pFile->Write((const char *)m_pInBuffer, m_nInBufferUsed);
+					assert(m_nInBufferUsed<=m_nBlockSize);
+					WriteBlock(m_pInBuffer, m_nInBufferUsed | 0x80000000, m_nInBufferUsed);
 				}
 				else
 				{
-					assert(m_nOutBufferUsed<=BufferSize);
-					if (BufferSize<=0x7fff)
-					{
-						unsigned short snResultBytes = static_cast<unsigned short>(m_nOutBufferUsed);
-						m_pFile->Write(&snResultBytes, sizeof(snResultBytes));
-					}
-					else
-						m_pFile->Write(&m_nOutBufferUsed, sizeof(m_nOutBufferUsed));
-					m_pFile->Write((const char *)m_pOutBuffer, m_nOutBufferUsed);
+					assert(m_nOutBufferUsed<=m_nBlockSize);
+					WriteBlock(m_pOutBuffer, m_nOutBufferUsed, m_nOutBufferUsed);
 				}
 				m_nInBufferUsed = 0;
 				m_nOutBufferUsed = 0;
+				m_nFirstRecord = -1;
 			}
 		};
 
+		// the blocks are written in order, so the next record to start is always one after the last one that did
+		inline void AddDirectoryEntry(const CompressBuffer *pBuffer)
+		{
+			LZFBlockEntry entry;
+			entry.nPos = pBuffer->m_pFile->Tell();
+			entry.nSize = pBuffer->m_nInBufferUsed;
+			if (pBuffer->m_nFirstRecord>=0)
+			{
+				entry.nFirstRecord = pBuffer->m_nFirstRecord;
+				entry.nFirstRecordOffset = pBuffer->m_nFirstRecordOffset;
+				m_nDirectoryNextRecord = pBuffer->m_nLastRecord+1;
+			}
+			else
+			{
+				entry.nFirstRecord = m_nDirectoryNextRecord;
+				entry.nFirstRecordOffset = entry.nSize;
+			}
+			m_pvDirectory->push_back(entry);
+		}
+
+		// called before compressing each buffer, in the master thread
+		inline CompressBuffer * StartCompress(CompressBuffer *pBuffer)
+		{
+			pBuffer->m_bProbe = m_bSkipIncompressible && m_nIncompressibleRun>0;
+			pBuffer->m_bChecksum = m_bChecksums;
+			return pBuffer;
+		}
+
 		inline void DoWrite(CompressBuffer *pCurrentBuffer)
 		{
 			try
 			{
+				bool bIncompressible = pCurrentBuffer->m_nOutBufferUsed==0;
+				if (m_pvDirectory)
+					AddDirectoryEntry(pCurrentBuffer);
 				pCurrentBuffer->DoWrite();
+				m_nIncompressibleRun = bIncompressible ? m_nIncompressibleRun+1 : 0;
 			}
 			catch (...)
 			{
@@ -129,7 +510,22 @@ namespace SRC
 				pCurrentBuffer->m_nOutBufferUsed = 0;
 
 				// go through all the buffers and flush them WITHOUT Writing, starting with the next one.
-				if (m_pNextBuffer->m_nInBufferUsed!=0)
+				if (m_pThreads.get())
+				{
+					// the threads might still be compressing any of them
+					for (size_t x=1; x<=m_vPipeline.size(); x++)
+					{
+						CompressBuffer *pBuffer = m_vPipeline[(m_nCurrentBuffer+x) % m_vPipeline.size()];
+						if (pBuffer->m_nInBufferUsed!=0)
+						{
+							m_pThreads->WaitForCompletion(pBuffer);
+							pBuffer->m_nInBufferUsed = 0;
+							pBuffer->m_nOutBufferUsed = 0;
+						}
+					}
+					throw;
+				}
+				if (m_pNextBuffer && m_pNextBuffer->m_nInBufferUsed!=0)
 				{
 #ifndef __GNUC__
 					m_pNextBuffer->WaitForCompletion();
@@ -156,37 +552,117 @@ namespace SRC
 		CompressBuffer *m_pCurrentBuffer;
 		CompressBuffer *m_pNextBuffer;
 
+		// with compression threads, the buffers are used round robin: m_buffer1 and then m_vPipelineBuffers.
+		// Everything after m_nCurrentBuffer (wrapping around) is queued or done, oldest first
+		std::vector<CompressBuffer *> m_vPipeline;
+		std::vector<std::unique_ptr<CompressBuffer> > m_vPipelineBuffers;
+		size_t m_nCurrentBuffer;
+		// declared after the buffers, so the threads are stopped before the buffers go away
+		std::unique_ptr<LZFThreads<CompressBuffer> > m_pThreads;
+
 		const TEngine *m_pEngine;
 
+		// see SetSkipIncompressible
+		bool m_bSkipIncompressible;
+		// how many blocks in a row have been written uncompressed
+		unsigned m_nIncompressibleRun;
+		// see SetChecksums
+		bool m_bChecksums;
+		// see SetBlockDirectory
+		std::vector<LZFBlockEntry> *m_pvDirectory;
+		__int64 m_nDirectoryNextRecord;
+
 	public:
-		LZFBufferedOutput(const TEngine *pEngine, TFileP pFile);
+		// nNumThreads>0 compresses on that many std::threads, with 2 buffers per thread in flight.
+		// otherwise it is done in the calling thread, or on Windows, double buffered on pEngine's threads.
+		// The reader has to be given the same nBlockSize.  The buffers come from pPool if there is one
+		LZFBufferedOutput(const TEngine *pEngine, TFileP pFile, unsigned nNumThreads = 0, BlockCodec codec = BlockCodec(), unsigned nBlockSize = LZFDefaultBlockSize, std::shared_ptr<LZFBufferPool> pPool = std::shared_ptr<LZFBufferPool>());
 		inline void FlushBuffer();
 		~LZFBufferedOutput();
 		void Write(const void *pBuffer, unsigned nSize);
+
+		// flushes and then marks the end of the data with a 0 length block, for readers that don't know
+		// how much there is.  An empty buffer is never written, so a real block can't look like this
+		void WriteEndMarker();
+
+		// once a block doesn't compress, the blocks after it are sampled first (see LooksIncompressible)
+		// and written uncompressed without trying the whole block when the sample doesn't compress either.
+		// Saves most of the compression time for files full of already compressed blobs
+		void SetSkipIncompressible(bool bSkip = true) { m_bSkipIncompressible = bSkip; }
+
+		// call before the 1st Write.  Each block gets a CRC32C (see LZFBlockChecksum) after its length,
+		// so the reader has to be told with LZFBufferedInput::SetChecksums
+		void SetChecksums(bool bChecksums = true) { m_bChecksums = bChecksums; }
+
+		// call before the 1st Write.  An LZFBlockEntry is added to *pvDirectory for each block as it is written.
+		// Where the records start comes from StartRecord, which has to be called before writing each one
+		void SetBlockDirectory(std::vector<LZFBlockEntry> *pvDirectory) { m_pvDirectory = pvDirectory; }
+		inline void StartRecord(__int64 nRecord)
+		{
+			// Write never leaves the current buffer full, so the record really does start in it
+			if (m_pCurrentBuffer->m_nFirstRecord<0)
+			{
+				m_pCurrentBuffer->m_nFirstRecord = nRecord;
+				m_pCurrentBuffer->m_nFirstRecordOffset = m_pCurrentBuffer->m_nInBufferUsed;
+			}
+			m_pCurrentBuffer->m_nLastRecord = nRecord;
+		}
 	};
 
-	template <class TFileP, class TEngine, unsigned BufferSize> LZFBufferedOutput<TFileP, TEngine, BufferSize>::LZFBufferedOutput(const TEngine *pEngine, TFileP pFile)
-		: m_buffer1(pFile, pEngine!=NULL)
+	template <class TFileP, class TEngine> LZFBufferedOutput<TFileP, TEngine>::LZFBufferedOutput(const TEngine *pEngine, TFileP pFile, unsigned nNumThreads /*= 0*/, BlockCodec codec /*= BlockCodec()*/, unsigned nBlockSize /*= LZFDefaultBlockSize*/, std::shared_ptr<LZFBufferPool> pPool /*= std::shared_ptr<LZFBufferPool>()*/)
+		: m_buffer1(pFile, codec, LZFCheckBlockSize(nBlockSize), pPool, pEngine!=NULL && nNumThreads==0)
+		, m_nCurrentBuffer(0)
 		, m_pEngine(pEngine)
+		, m_bSkipIncompressible(false)
+		, m_nIncompressibleRun(0)
+		, m_bChecksums(false)
+		, m_pvDirectory(NULL)
+		, m_nDirectoryNextRecord(0)
 	{
 		m_pCurrentBuffer = &m_buffer1;
-		if (m_pEngine)
+		m_pNextBuffer = NULL;
+		if (nNumThreads>0)
+		{
+			m_vPipeline.push_back(&m_buffer1);
+			for (unsigned x=1; x<2*nNumThreads; x++)
+			{
+				m_vPipelineBuffers.push_back(std::unique_ptr<CompressBuffer>(new CompressBuffer(pFile, codec, nBlockSize, pPool, false)));
+				m_vPipeline.push_back(m_vPipelineBuffers.back().get());
+			}
+			m_pThreads.reset(new LZFThreads<CompressBuffer>(nNumThreads));
+		}
+		else if (m_pEngine)
 		{
-			m_pBuffer2.reset(new CompressBuffer(pFile, pEngine!=NULL));
+			m_pBuffer2.reset(new CompressBuffer(pFile, codec, nBlockSize, pPool, pEngine!=NULL));
 			m_pNextBuffer = m_pBuffer2.get();
 		}
-		else
-			m_pNextBuffer = NULL;
 	}
 
-	template <class TFileP, class TEngine, unsigned BufferSize> void LZFBufferedOutput<TFileP, TEngine, BufferSize>::FlushBuffer()
+	template <class TFileP, class TEngine> void LZFBufferedOutput<TFileP, TEngine>::FlushBuffer()
 	{
+		if (m_pThreads.get())
+		{
+			if (m_pCurrentBuffer->m_nInBufferUsed!=0)
+				m_pThreads->Queue(StartCompress(m_pCurrentBuffer));
+
+			// write out everything that is queued, oldest first - ending with the current buffer
+			for (size_t x=1; x<=m_vPipeline.size(); x++)
+			{
+				CompressBuffer *pBuffer = m_vPipeline[(m_nCurrentBuffer+x) % m_vPipeline.size()];
+				if (pBuffer->m_nInBufferUsed!=0)
+				{
+					m_pThreads->WaitForCompletion(pBuffer);
+					DoWrite(pBuffer);
+				}
+			}
+		}
+		else
 #ifndef __GNUC__
 		if (m_pEngine)
 		{
 			// queue up compressing this buffer so it can happen while we are writing the previos data
 			if (m_pCurrentBuffer->m_nInBufferUsed!=0)
-				m_pEngine->QueueThread(CompressBuffer::DoCompress, m_pCurrentBuffer);
+				m_pEngine->QueueThread(CompressBuffer::DoCompress, StartCompress(m_pCurrentBuffer));
 			
 			// the Next in this case might actually be the previous so we have to write it 1st
 			// if it has no data, the write does nothing
@@ -207,29 +683,42 @@ namespace SRC
 			// single threaded mode
 			if (m_pCurrentBuffer->m_nInBufferUsed!=0)
 			{
-				m_pCurrentBuffer->DoCompress();
+				StartCompress(m_pCurrentBuffer)->DoCompress();
 				DoWrite(m_pCurrentBuffer);
 			}
 		}
 	}
 
-	template <class TFileP, class TEngine, unsigned BufferSize> void LZFBufferedOutput<TFileP, TEngine, BufferSize>::Write(const void *pBuffer, unsigned nSize)
+	template <class TFileP, class TEngine> void LZFBufferedOutput<TFileP, TEngine>::Write(const void *pBuffer, unsigned nSize)
 	{
 		while (nSize>0)
 		{
-			unsigned nCopySize = std::min(BufferSize-m_pCurrentBuffer->m_nInBufferUsed, nSize);
+			unsigned nCopySize = std::min(m_pCurrentBuffer->m_nBlockSize-m_pCurrentBuffer->m_nInBufferUsed, nSize);
 			memcpy(m_pCurrentBuffer->m_pInBuffer+m_pCurrentBuffer->m_nInBufferUsed, pBuffer, nCopySize);
 			m_pCurrentBuffer->m_nInBufferUsed += nCopySize;
 			nSize -= nCopySize;
 			pBuffer = ((char *)pBuffer) + nCopySize;
 
-			if (m_pCurrentBuffer->m_nInBufferUsed==BufferSize)
+			if (m_pCurrentBuffer->m_nInBufferUsed==m_pCurrentBuffer->m_nBlockSize)
 			{
+				if (m_pThreads.get())
+				{
+					// queue it up, and move on to the oldest buffer - which needs writing out first if it has anything in it
+					m_pThreads->Queue(StartCompress(m_pCurrentBuffer));
+					m_nCurrentBuffer = (m_nCurrentBuffer+1) % m_vPipeline.size();
+					m_pCurrentBuffer = m_vPipeline[m_nCurrentBuffer];
+					if (m_pCurrentBuffer->m_nInBufferUsed!=0)
+					{
+						m_pThreads->WaitForCompletion(m_pCurrentBuffer);
+						DoWrite(m_pCurrentBuffer);
+					}
+				}
+				else
 #ifndef __GNUC__
 				if (m_pEngine)
 				{
 					// queue up the data for compressing
-					m_pEngine->QueueThread(CompressBuffer::DoCompress, m_pCurrentBuffer);
+					m_pEngine->QueueThread(CompressBuffer::DoCompress, StartCompress(m_pCurrentBuffer));
 					
 					// switch to the next buffer that is hopefully already done compressing
 					std::swap(m_pCurrentBuffer, m_pNextBuffer);
@@ -246,105 +735,536 @@ namespace SRC
 #endif
 				{
 					// single threaded mode
-					m_pCurrentBuffer->DoCompress();
+					StartCompress(m_pCurrentBuffer)->DoCompress();
 					DoWrite(m_pCurrentBuffer);
 				}
 			}
 		}
 	}
 
-	template <class TFileP, class TEngine, unsigned BufferSize> LZFBufferedOutput<TFileP, TEngine, BufferSize>::~LZFBufferedOutput()
+	template <class TFileP, class TEngine> void LZFBufferedOutput<TFileP, TEngine>::WriteEndMarker()
 	{
 		FlushBuffer();
+
+		unsigned char pMarker[CompressBuffer::LengthSize];
+		CompressBuffer::PutLength(pMarker, 0);
+		m_buffer1.m_pFile->Write((const char *)pMarker, sizeof(pMarker));
+	}
+
+	template <class TFileP, class TEngine> LZFBufferedOutput<TFileP, TEngine>::~LZFBufferedOutput()
+	{
+		// normally everything was flushed already.  If that failed, there is no one left to tell
+		try
+		{
+			FlushBuffer();
+		}
+		catch (...)
+		{
+		}
+	}
+
+	// files that already hold their data in memory (memory mapped, etc...) can overload this for their
+	// pointer type to return a pointer to the next nSize bytes, advancing the file past them.
+	// LZFBufferedInput will then decompress directly out of that memory instead of Reading into m_pInBuffer
+	template <class TFileP> inline const void * LZFGetInPlace(const TFileP &/*pFile*/, unsigned /*nSize*/)
+	{
+		return NULL;
+	}
+
+	// the same, for a file that can also return a pointer to the nSize bytes at nPos - without moving the file
+	template <class TFileP> inline const void * LZFGetAtInPlace(const TFileP &/*pFile*/, __int64 /*nPos*/, unsigned /*nSize*/)
+	{
+		return NULL;
+	}
+
+	// reads and decompresses the one block at nPos into pOut, which has room for nBlockSize.  Returns how much it holds.
+	// This doesn't use or move the file position, so any number of threads can read their own blocks out of the same
+	// file at once - given the positions from a block directory (see LZFBlockEntry).  r_vIn is scratch space
+	template <class TFileP> unsigned LZFReadBlockAt(TFileP pFile, __int64 nPos, unsigned nBlockSize, const BlockCodec &codec, bool bChecksums, std::vector<unsigned char> &r_vIn, unsigned char *pOut)
+	{
+		unsigned pPrefix[2] = { 0, 0 };
+		unsigned nPrefixSize = bChecksums ? 2*sizeof(unsigned) : sizeof(unsigned);
+		if (nPrefixSize!=pFile->ReadAt(nPos, pPrefix, nPrefixSize))
+			throw Error("Internal Error in LZFReadBlockAt: Not enough bytes read");
+
+		bool bUncompressed = (pPrefix[0] & 0x80000000)!=0;
+		unsigned nSize = pPrefix[0] & 0x7fffffff;
+		if (nSize>nBlockSize || nSize==0)
+			throw Error("Internal Error in LZFReadBlockAt: corrupt file.");
+
+		const void *pIn = LZFGetAtInPlace(pFile, nPos+nPrefixSize, nSize);
+		if (!pIn)
+		{
+			// an uncompressed block can go straight to where it ends up
+			unsigned char *pBuffer = pOut;
+			if (!bUncompressed)
+			{
+				if (r_vIn.size()<nSize)
+					r_vIn.resize(nBlockSize);
+				pBuffer = &r_vIn[0];
+			}
+			if (nSize!=pFile->ReadAt(nPos+nPrefixSize, pBuffer, nSize))
+				throw Error("Internal Error in LZFReadBlockAt: Not enough bytes read");
+			pIn = pBuffer;
+		}
+
+		if (bChecksums && LZFBlockChecksum(pPrefix[0], pIn, nSize)!=pPrefix[1])
+			throw Error("LZFReadBlockAt: A block failed its checksum.  The file is corrupt.");
+
+		if (bUncompressed)
+		{
+			if (pIn!=pOut)
+				memcpy(pOut, pIn, nSize);
+			return nSize;
+		}
+
+		unsigned nRet = codec.Decompress(pIn, nSize, pOut, nBlockSize);
+		if (nRet==0)
+			throw Error("Internal Error in LZFReadBlockAt: corrupt file.");
+		return nRet;
 	}
 
 	////////////////////////////////////////////////////////////////////////////////
-	// class LZFBufferedOutput
+	// class LZFBufferedInput
 	// TFileP is usually a SmartPointer to a file
-	template <class TFileP, unsigned BufferSize=0x40000> class LZFBufferedInput : public SmartPointerRefObj_Base
+	template <class TFileP> class LZFBufferedInput : public SmartPointerRefObj_Base
 	{
-		unsigned char m_pOutBuffer[BufferSize];
-		unsigned char m_pInBuffer[BufferSize];
+		const unsigned m_nBlockSize;
+		// only without threads - otherwise the slots have the buffers
+		std::unique_ptr<LZFBuffer> m_pOutBuffer;
+		std::unique_ptr<LZFBuffer> m_pInBuffer;
+		// this points at m_pOutBuffer, unless an uncompressed block could be used in place
+		const unsigned char *m_pOutData;
 		unsigned nInBufferNext;
 		unsigned nInBufferSize;
 
 		TFileP m_pFile;
+		BlockCodec m_codec;
+		// see SetChecksums
+		bool m_bChecksums;
+		bool m_bVerify;
+
+		// with decompression threads, the blocks are read ahead into a ring of slots, decompressed on the
+		// threads, and used in order.  m_nHead is the oldest, and the m_nQueued after it have a block in them
+		struct Slot
+		{
+			const unsigned m_nBlockSize;
+			LZFBuffer m_inBuffer;
+			LZFBuffer m_outBuffer;
+			unsigned m_nInSize;
+			unsigned m_nOutSize;
+			bool m_bUncompressed;
+			unsigned m_nChecksum;
+			bool m_bVerify;
+			bool m_bBadChecksum;
+			// where the next block starts in the file
+			__int64 m_nNextBlockPos;
+			const BlockCodec *m_pCodec;
+
+			// only used by LZFThreads, under its lock
+			bool m_bDone;
 
+			inline Slot(unsigned nBlockSize, const std::shared_ptr<LZFBufferPool> &pPool)
+				: m_nBlockSize(nBlockSize), m_inBuffer(nBlockSize, pPool), m_outBuffer(nBlockSize, pPool)
+				, m_nInSize(0), m_nOutSize(0), m_bUncompressed(false), m_nChecksum(0), m_bVerify(false), m_bBadChecksum(false)
+				, m_nNextBlockPos(0), m_pCodec(NULL), m_bDone(true)
+			{
+			}
+			inline void DoWork()
+			{
+				m_bBadChecksum = m_bVerify && !CheckBlock(m_inBuffer.Get(), m_nInSize, m_bUncompressed, m_nChecksum);
+				if (m_bUncompressed)
+					m_nOutSize = m_nInSize;
+				else if (!m_bBadChecksum)
+					m_nOutSize = m_pCodec->Decompress(m_inBuffer.Get(), m_nInSize, m_outBuffer.Get(), m_nBlockSize);
+			}
+		};
+		std::vector<std::unique_ptr<Slot> > m_vSlots;
+		size_t m_nHead;
+		size_t m_nQueued;
+		bool m_bHeadInUse;
+		bool m_bReadAheadDone;
+		__int64 m_nEndPos;
+		__int64 m_nNextBlockPos;
+		// declared after the slots, so the threads are stopped before the slots go away
+		std::unique_ptr<LZFThreads<Slot> > m_pThreads;
+
+		static inline bool CheckBlock(const void *pData, unsigned nSize, bool bUncompressed, unsigned nChecksum)
+		{
+			return LZFBlockChecksum(bUncompressed ? (nSize | 0x80000000) : nSize, pData, nSize)==nChecksum;
+		}
+
+		bool ReadLength(unsigned &r_nResultBytes, bool &r_bUncompressed, unsigned &r_nChecksum);
+		bool ReadBlock();
+		bool ReadBlockThreaded();
+		void QueueBlocks();
+
+		LZFBufferedInput(const LZFBufferedInput &);
+		LZFBufferedInput & operator =(const LZFBufferedInput &);
 	public:
-		LZFBufferedInput(TFileP pFile);
+		// nNumThreads>0 reads ahead and decompresses 2 blocks per thread in the background.
+		// It never reads ahead past nEndPos (the end of the records), or if that is -1, past the end marker.
+		// nBlockSize is what the file was written with.  The buffers come from pPool if there is one
+		LZFBufferedInput(TFileP pFile, unsigned nNumThreads = 0, __int64 nEndPos = -1, BlockCodec codec = BlockCodec(), unsigned nBlockSize = LZFDefaultBlockSize, std::shared_ptr<LZFBufferPool> pPool = std::shared_ptr<LZFBufferPool>());
+		~LZFBufferedInput()
+		{
+			Reset();
+		}
+		// call after moving the file position
 		void Reset()
 		{
 			nInBufferSize = 0;
 			nInBufferNext = 0;
+			if (m_pThreads.get())
+			{
+				// the threads may still be working on anything that was read ahead
+				for (size_t x=0; x<m_nQueued; x++)
+					m_pThreads->WaitForCompletion(m_vSlots[(m_nHead+x) % m_vSlots.size()].get());
+				m_nQueued = 0;
+				m_bHeadInUse = false;
+				m_bReadAheadDone = false;
+			}
+			// nothing has been read from the new position yet, so IsAtBlock can't match until a block is
+			m_nNextBlockPos = -1;
 		}
 		unsigned Read(void *pBuffer, unsigned nSize);
+		// like Read, but just moves past the data
+		unsigned Skip(unsigned nSize);
+		// the rest of the current decompressed block in place, reading the next block first if this one is used up.
+		// Doesn't move past anything - Skip does that.  Good until the next Read, Skip or Peek.  NULL at the end
+		const void * Peek(unsigned &r_nAvailable);
+
+		// with threads, the file has been read past what has been used.  This is true if everything up to
+		// nPos has been used and nothing after it, so moving the file to nPos (and Reset) can be skipped
+		bool IsAtBlock(__int64 nPos) const
+		{
+			return m_pThreads.get() && nInBufferNext>=nInBufferSize && m_nNextBlockPos==nPos;
+		}
+
+		// true if everything has been read - at the end of the file or at a LZFBufferedOutput::WriteEndMarker
+		bool IsEnd()
+		{
+			return nInBufferNext>=nInBufferSize && !ReadBlock();
+		}
 
 		TFileP GetFile() { return m_pFile;}
+
+		// call before the 1st Read.  The blocks were written with LZFBufferedOutput::SetChecksums.
+		// With bVerify, each block is checked as it is read (on the decompression threads if there are any)
+		// and a bad one throws instead of being decompressed
+		void SetChecksums(bool bChecksums, bool bVerify = true)
+		{
+			m_bChecksums = bChecksums;
+			m_bVerify = bChecksums && bVerify;
+		}
+
+		// checks the checksum of every block from here to the end without decompressing anything - much faster
+		// than reading the records.  Throws at the 1st bad block.  Call in place of Read, not along with it
+		void VerifyBlocks();
 	};
-	template <class TFileP, unsigned BufferSize> LZFBufferedInput<TFileP, BufferSize>::LZFBufferedInput(TFileP pFile)
-		: nInBufferNext(0), nInBufferSize(0)
+	template <class TFileP> LZFBufferedInput<TFileP>::LZFBufferedInput(TFileP pFile, unsigned nNumThreads /*= 0*/, __int64 nEndPos /*= -1*/, BlockCodec codec /*= BlockCodec()*/, unsigned nBlockSize /*= LZFDefaultBlockSize*/, std::shared_ptr<LZFBufferPool> pPool /*= std::shared_ptr<LZFBufferPool>()*/)
+		: m_nBlockSize(LZFCheckBlockSize(nBlockSize)), m_pOutData(NULL), nInBufferNext(0), nInBufferSize(0), m_codec(codec), m_bChecksums(false), m_bVerify(false)
+		, m_nHead(0), m_nQueued(0), m_bHeadInUse(false), m_bReadAheadDone(false), m_nEndPos(nEndPos), m_nNextBlockPos(-1)
 	{
 		m_pFile = pFile;
+		if (nNumThreads>0)
+		{
+			for (unsigned x=0; x<2*nNumThreads; x++)
+			{
+				m_vSlots.push_back(std::unique_ptr<Slot>(new Slot(nBlockSize, pPool)));
+				m_vSlots.back()->m_pCodec = &m_codec;
+			}
+			m_pThreads.reset(new LZFThreads<Slot>(nNumThreads));
+		}
+		else
+		{
+			m_pOutBuffer.reset(new LZFBuffer(nBlockSize, pPool));
+			m_pInBuffer.reset(new LZFBuffer(nBlockSize, pPool));
+		}
+	}
+
+	// reads the length in front of a block.  returns false at the end (of the file, or the end marker)
+	template <class TFileP> bool LZFBufferedInput<TFileP>::ReadLength(unsigned &r_nResultBytes, bool &r_bUncompressed, unsigned &r_nChecksum)
+	{
+		unsigned nResultBytes = 0;
+		bool bUncompressed = false;
+		m_pFile->Read(&nResultBytes, sizeof(nResultBytes));
+		if (nResultBytes & 0x80000000)
+		{
+			nResultBytes &= 0x7fffffff;
+			bUncompressed = true;
+		}
+
+		if (nResultBytes>m_nBlockSize)
+		{
+			assert(false);
+			throw Error("Internal Error in LZFBufferedInput<TFileP>::Read: corrupt file.");
+		}
+
+		r_nResultBytes = nResultBytes;
+		r_bUncompressed = bUncompressed;
+
+		// the end marker
+		if (nResultBytes==0 && !bUncompressed)
+			return false;
+
+		if (m_bChecksums && sizeof(r_nChecksum)!=m_pFile->Read(&r_nChecksum, sizeof(r_nChecksum)))
+			throw Error("Internal Error in LZFBufferedInput<TFileP>::Read: Not enough bytes read");
+		return true;
+	}
+
+	// reads blocks into all the free slots and queues them up to be decompressed
+	template <class TFileP> void LZFBufferedInput<TFileP>::QueueBlocks()
+	{
+		while (m_nQueued<m_vSlots.size() && !m_bReadAheadDone)
+		{
+			if (m_nEndPos>=0 && m_pFile->Tell()>=m_nEndPos)
+			{
+				m_bReadAheadDone = true;
+				break;
+			}
+
+			Slot *pSlot = m_vSlots[(m_nHead+m_nQueued) % m_vSlots.size()].get();
+			if (!ReadLength(pSlot->m_nInSize, pSlot->m_bUncompressed, pSlot->m_nChecksum))
+			{
+				m_bReadAheadDone = true;
+				break;
+			}
+			if (pSlot->m_nInSize!=m_pFile->Read(pSlot->m_inBuffer.Get(), pSlot->m_nInSize))
+				throw Error("Internal Error in LZFBufferedInput<TFileP>::Read: Not enough bytes read");
+			pSlot->m_nNextBlockPos = m_pFile->Tell();
+
+			m_nQueued++;
+			pSlot->m_bVerify = m_bVerify;
+			pSlot->m_bBadChecksum = false;
+			if (pSlot->m_bUncompressed && !m_bVerify)
+				pSlot->m_nOutSize = pSlot->m_nInSize;
+			else
+				m_pThreads->Queue(pSlot);
+		}
+	}
+
+	template <class TFileP> bool LZFBufferedInput<TFileP>::ReadBlockThreaded()
+	{
+		nInBufferNext = 0;
+		nInBufferSize = 0;
+
+		// the head slot is all used up, so it can be read into again
+		if (m_bHeadInUse)
+		{
+			m_nHead = (m_nHead+1) % m_vSlots.size();
+			m_nQueued--;
+			m_bHeadInUse = false;
+		}
+
+		QueueBlocks();
+		if (m_nQueued==0)
+			return false;
+
+		Slot *pSlot = m_vSlots[m_nHead].get();
+		m_pThreads->WaitForCompletion(pSlot);
+		m_bHeadInUse = true;
+		m_nNextBlockPos = pSlot->m_nNextBlockPos;
+
+		if (pSlot->m_bBadChecksum)
+			throw Error("LZFBufferedInput: A block failed its checksum.  The file is corrupt.");
+
+		m_pOutData = pSlot->m_bUncompressed ? pSlot->m_inBuffer.Get() : pSlot->m_outBuffer.Get();
+		nInBufferSize = pSlot->m_nOutSize;
+		if (nInBufferSize == 0)
+		{
+			if (!pSlot->m_bUncompressed)
+				throw Error("Internal Error in LZFBufferedInput<TFileP>::Read: corrupt file.");
+			return false;
+		}
+		return true;
+	}
+
+	// reads and decompresses the next block.  returns false at the end
+	template <class TFileP> bool LZFBufferedInput<TFileP>::ReadBlock()
+	{
+		if (m_pThreads.get())
+			return ReadBlockThreaded();
+
+		nInBufferNext = 0;
+		nInBufferSize = 0;
+
+		// the same end as the read ahead - whatever follows the records isn't blocks
+		if (m_nEndPos>=0 && m_pFile->Tell()>=m_nEndPos)
+			return false;
+
+		unsigned nResultBytes = 0;
+		bool bUncompressed = false;
+		unsigned nChecksum = 0;
+		if (!ReadLength(nResultBytes, bUncompressed, nChecksum))
+			return false;
+
+		const unsigned char *pInPlace = static_cast<const unsigned char *>(LZFGetInPlace(m_pFile, nResultBytes));
+		if (!pInPlace)
+		{
+			// an uncompressed block is read straight into where it is used from
+			unsigned char *pBuffer = bUncompressed ? m_pOutBuffer->Get() : m_pInBuffer->Get();
+			if (nResultBytes!=m_pFile->Read(pBuffer, nResultBytes))
+				throw Error("Internal Error in LZFBufferedInput<TFileP>::Read: Not enough bytes read");
+			pInPlace = pBuffer;
+		}
+
+		if (m_bVerify && !CheckBlock(pInPlace, nResultBytes, bUncompressed, nChecksum))
+			throw Error("LZFBufferedInput: A block failed its checksum.  The file is corrupt.");
+
+		if (bUncompressed)
+		{
+			nInBufferSize = nResultBytes;
+			m_pOutData = pInPlace;
+		}
+		else
+		{
+			m_pOutData = m_pOutBuffer->Get();
+			nInBufferSize = m_codec.Decompress(pInPlace, nResultBytes, m_pOutBuffer->Get(), m_nBlockSize);
+			if (nInBufferSize == 0)
+				throw Error("Internal Error in LZFBufferedInput<TFileP>::Read: corrupt file.");
+		}
+		return true;
+	}
+
+	template <class TFileP> void LZFBufferedInput<TFileP>::VerifyBlocks()
+	{
+		if (!m_bChecksums)
+			throw Error("LZFBufferedInput::VerifyBlocks: The blocks do not have checksums.");
+
+		// the slots are only for decompressing, so this always reads in this thread
+		LZFBuffer buffer(m_nBlockSize, std::shared_ptr<LZFBufferPool>());
+		for (;;)
+		{
+			if (m_nEndPos>=0 && m_pFile->Tell()>=m_nEndPos)
+				break;
+
+			unsigned nResultBytes = 0;
+			bool bUncompressed = false;
+			unsigned nChecksum = 0;
+			if (!ReadLength(nResultBytes, bUncompressed, nChecksum))
+				break;
+
+			const void *pData = LZFGetInPlace(m_pFile, nResultBytes);
+			if (!pData)
+			{
+				if (nResultBytes!=m_pFile->Read(buffer.Get(), nResultBytes))
+					throw Error("Internal Error in LZFBufferedInput<TFileP>::Read: Not enough bytes read");
+				pData = buffer.Get();
+			}
+			if (!CheckBlock(pData, nResultBytes, bUncompressed, nChecksum))
+				throw Error("LZFBufferedInput: A block failed its checksum.  The file is corrupt.");
+		}
 	}
 
-	template <class TFileP, unsigned BufferSize> unsigned LZFBufferedInput<TFileP, BufferSize>::Read(void *pBuffer, unsigned nSize)
+	template <class TFileP> unsigned LZFBufferedInput<TFileP>::Read(void *pBuffer, unsigned nSize)
 	{
 		unsigned nRet = nSize;
 		while (nSize>0)
 		{
 			if (nInBufferSize<=nInBufferNext)
 			{
-				unsigned nResultBytes = 0;
-				bool bUncompressed = false;
-				if (BufferSize<=0x7fff)
-				{
-					unsigned short snResultBytes = static_cast<unsigned short>(nResultBytes);
-					unsigned nBytesRead = m_pFile->Read(&snResultBytes, sizeof(snResultBytes));
-					if (nBytesRead==0)
-						return nRet-nSize;  // EOF
-					if (sizeof(snResultBytes)!=nBytesRead)
-						throw Error("Internal Error in LZFBufferedInput<TFileP, BufferSize>::Read");
-					if (snResultBytes & 0x8000)
-					{
-						snResultBytes &= 0x7fff;
-						bUncompressed = true;
-					}
-					nResultBytes = snResultBytes;
-				}
-				else
-				{
-					m_pFile->Read(&nResultBytes, sizeof(nResultBytes));
-					if (nResultBytes & 0x80000000)
-					{
-						nResultBytes &= 0x7fffffff;
-						bUncompressed = true;
-					}
-				}
+				if (!ReadBlock())
+					return nRet-nSize;
+			}
+			unsigned nCopySize = std::min(unsigned(nInBufferSize-nInBufferNext), nSize);
+			memcpy(pBuffer, m_pOutData+nInBufferNext, nCopySize);
+			nInBufferNext += nCopySize;
+			nSize -= nCopySize;
+			pBuffer = ((char *)pBuffer) + nCopySize;
+		}
+		return nRet;
+	}
 
-				if (bUncompressed)
-				{
-					nInBufferSize = nResultBytes;
-					if (nInBufferSize>sizeof(m_pOutBuffer))
-					{
-						assert(false);
-						throw Error("Internal Error in LZFBufferedInput<TFileP>::Read: corrupt file.");
-					}
+	template <class TFileP> unsigned LZFBufferedInput<TFileP>::Skip(unsigned nSize)
+	{
+		unsigned nRet = nSize;
+		while (nSize>0)
+		{
+			if (nInBufferSize<=nInBufferNext)
+			{
+				if (!ReadBlock())
+					return nRet-nSize;
+			}
+			unsigned nSkipSize = std::min(unsigned(nInBufferSize-nInBufferNext), nSize);
+			nInBufferNext += nSkipSize;
+			nSize -= nSkipSize;
+		}
+		return nRet;
+	}
 
-					if (nInBufferSize!=m_pFile->Read(m_pOutBuffer, nInBufferSize))
-						throw Error("Internal Error in LZFBufferedInput<TFileP>::Read: Not enough bytes read");
-				}
-				else
+	template <class TFileP> const void * LZFBufferedInput<TFileP>::Peek(unsigned &r_nAvailable)
+	{
+		if (nInBufferSize<=nInBufferNext && !ReadBlock())
+		{
+			r_nAvailable = 0;
+			return NULL;
+		}
+		r_nAvailable = unsigned(nInBufferSize-nInBufferNext);
+		return m_pOutData+nInBufferNext;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	// class BufferedInput
+	// the same interface as LZFBufferedInput, for files that aren't compressed.
+	// Reads the file in big pieces instead of a couple of tiny reads per record,
+	// or if the file already has the data in memory, copies straight from there.
+	// The buffer is never filled past nEndPos (the end of the records), since the file would see that as a short read.
+	// -1 reads up to the end of the file
+	template <class TFileP, unsigned BufferSize=0x40000> class BufferedInput : public SmartPointerRefObj_Base
+	{
+		unsigned char m_pBuffer[BufferSize];
+		unsigned m_nBufferNext;
+		unsigned m_nBufferSize;
+
+		TFileP m_pFile;
+		__int64 m_nEndPos;
+
+	public:
+		BufferedInput(TFileP pFile, __int64 nEndPos)
+			: m_nBufferNext(0), m_nBufferSize(0), m_pFile(pFile), m_nEndPos(nEndPos)
+		{
+		}
+		// call after moving the file position
+		void Reset()
+		{
+			m_nBufferSize = 0;
+			m_nBufferNext = 0;
+		}
+		unsigned Read(void *pBuffer, unsigned nSize);
+
+		TFileP GetFile() { return m_pFile;}
+	};
+
+	template <class TFileP, unsigned BufferSize> unsigned BufferedInput<TFileP, BufferSize>::Read(void *pBuffer, unsigned nSize)
+	{
+		unsigned nRet = nSize;
+		while (nSize>0)
+		{
+			if (m_nBufferSize<=m_nBufferNext)
+			{
+				const void *pInPlace = LZFGetInPlace(m_pFile, nSize);
+				if (pInPlace)
 				{
-					size_t nBytesRead = m_pFile->Read(m_pInBuffer, nResultBytes);
-					nInBufferSize = lzf_decompress(m_pInBuffer, unsigned(nBytesRead), m_pOutBuffer, unsigned(sizeof(m_pOutBuffer)));
-					if (nInBufferSize == 0)
-						return 0;  // EOF - may get in infinite loop
+					memcpy(pBuffer, pInPlace, nSize);
+					return nRet;
 				}
-				nInBufferNext = 0;
+
+				// no point copying something this big through the buffer
+				if (nSize>=BufferSize)
+					return nRet - nSize + m_pFile->Read(pBuffer, nSize);
+
+				__int64 nRemaining = m_nEndPos>=0 ? m_nEndPos - m_pFile->Tell() : __int64(BufferSize);
+				if (nRemaining<=0)
+					return nRet-nSize;  // EOF
+				m_nBufferSize = m_pFile->Read(m_pBuffer, unsigned(std::min(__int64(BufferSize), nRemaining)));
+				m_nBufferNext = 0;
+				if (m_nBufferSize==0)
+					return nRet-nSize;  // EOF
 			}
-			unsigned nCopySize = std::min(unsigned(nInBufferSize-nInBufferNext), nSize);
-			memcpy(pBuffer, m_pOutBuffer+nInBufferNext, nCopySize);
-			nInBufferNext += nCopySize;
+			unsigned nCopySize = std::min(unsigned(m_nBufferSize-m_nBufferNext), nSize);
+			memcpy(pBuffer, m_pBuffer+m_nBufferNext, nCopySize);
+			m_nBufferNext += nCopySize;
 			nSize -= nCopySize;
 			pBuffer = ((char *)pBuffer) + nCopySize;
 		}